@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+/**
+ * Helpers shared by the benchmarks, include from exactly one translation unit per executable as it
+ * replaces the global operator new to count heap allocations.
+ */
+namespace bench {
+inline std::atomic<size_t>& allocations()
+{
+    static std::atomic<size_t> count(0);
+    return count;
+}
+
+/// bytes requested from operator new, not counting what was freed
+inline std::atomic<size_t>& allocated_bytes()
+{
+    static std::atomic<size_t> bytes(0);
+    return bytes;
+}
+
+class stopwatch
+{
+public:
+    stopwatch():
+        m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    double elapsed_ns() const
+    {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+    double elapsed_s() const
+    {
+        return elapsed_ns() / 1e9;
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+/**
+ * Stops the benchmark when ok is false. Benchmarks build in release, where assert is compiled out,
+ * and numbers measured past a failed setup would be meaningless.
+ */
+inline void check(bool ok, const char* what)
+{
+    if (ok)
+        return;
+    std::fprintf(stderr, "%s failed\n", what);
+    std::exit(1);
+}
+
+/// Value sink that the optimizer can't see through
+template<typename T>
+inline void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+}
+
+namespace bench {
+inline void* counted_malloc(size_t size) noexcept
+{
+    allocations().fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes().fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+}
+
+/*
+ * Every form of operator new and delete is replaced so that they all agree on malloc and free.
+ * GCC sees the free of what it takes for memory of the standard operator new, once inlined into a
+ * delete expression, and warns of a mismatch which isn't one here.
+ */
+#if defined(__GNUC__) && ! defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size)
+{
+    if (void* p = bench::counted_malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    if (void* p = bench::counted_malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return bench::counted_malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return bench::counted_malloc(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+#ifdef __cpp_aligned_new
+namespace bench {
+inline void* counted_aligned_malloc(size_t size, std::align_val_t alignment) noexcept
+{
+    allocations().fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes().fetch_add(size, std::memory_order_relaxed);
+    const size_t a = std::max(static_cast<size_t>(alignment), sizeof(void*));
+    void* p = nullptr;
+    return posix_memalign(&p, a, size ? size : 1) == 0 ? p : nullptr;
+}
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    if (void* p = bench::counted_aligned_malloc(size, alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    if (void* p = bench::counted_aligned_malloc(size, alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return bench::counted_aligned_malloc(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return bench::counted_aligned_malloc(size, alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+#endif
+
+#if defined(__GNUC__) && ! defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,139 @@
+/**
+ * Compares the runtime indexed callbacks table against the typed callback slots used by the
+ * wrappers: cost per dispatch and heap allocations per accepted Tcp. Also the cost the loop
+ * metrics and the slow callback detector add to a dispatch.
+ */
+#include <uv.h>
+#include "uvpp/tcp.hpp"
+#include "bench.h"
+
+#include <iostream>
+
+using namespace uvpp;
+
+typedef std::function<void(const char*, ssize_t)> read_callback_t;
+
+namespace {
+const size_t dispatches = 50000000;
+const size_t connections = 100000;
+
+double dispatch_legacy()
+{
+    callbacks table;
+    size_t total = 0;
+    callbacks::store(&table, internal::uv_cid_read_start, read_callback_t([&total](const char*, ssize_t len)
+    {
+        total += len;
+    }));
+
+    const char* buf = "";
+    bench::stopwatch sw;
+    for (size_t i = 0; i < dispatches; ++i)
+        callbacks::invoke<read_callback_t>(&table, internal::uv_cid_read_start, buf, static_cast<ssize_t>(i & 0xff));
+    const double ns = sw.elapsed_ns();
+    bench::do_not_optimize(total);
+    return ns / dispatches;
+}
+
+template<typename callback_t>
+double dispatch_slots(callback_t callback)
+{
+    internal::handle_traits<uv_tcp_t>::callbacks_type slots;
+    slots.store<internal::uv_cid_read_start>(callback);
+
+    const char* buf = "";
+    bench::stopwatch sw;
+    for (size_t i = 0; i < dispatches; ++i)
+        slots.invoke<internal::uv_cid_read_start>(buf, static_cast<ssize_t>(i & 0xff));
+    return sw.elapsed_ns() / dispatches;
+}
+
+/// dispatch through the handle block as the libuv callbacks do, with the given hooks current
+double dispatch_hooked(loop& l, internal::dispatch_hooks* hooks)
+{
+    typedef internal::handle_block<uv_tcp_t> block_type;
+    block_type* block = block_type::create(l.get(), 1);
+    internal::dispatcher<block_type> slots(*block);
+    slots.store<internal::uv_cid_read_start>([](const char* p, ssize_t len) { bench::do_not_optimize(p + len); });
+
+    internal::current_dispatch_hooks() = hooks;
+    const char* buf = "";
+    bench::stopwatch sw;
+    for (size_t i = 0; i < dispatches; ++i)
+        slots.invoke<internal::uv_cid_read_start>(buf, static_cast<ssize_t>(i & 0xff));
+    const double ns = sw.elapsed_ns() / dispatches;
+    internal::current_dispatch_hooks() = nullptr;
+    block->release();
+    return ns;
+}
+
+double dispatch_detector(loop& l, unsigned sample_every)
+{
+    internal::callback_counters counters;
+    slow_callback_detector detector(std::chrono::milliseconds(1), [](const slow_callback&) {}, sample_every);
+    internal::dispatch_hooks hooks;
+    hooks.counters = &counters;
+    hooks.slow = &detector;
+    return dispatch_hooked(l, &hooks);
+}
+
+/// What handle<uv_tcp_t> did before the slot table: heap uv_tcp_t, heap callbacks, one heap object per stored callback
+double allocations_legacy(loop& l)
+{
+    const size_t before = bench::allocations();
+    for (size_t i = 0; i < connections; ++i)
+    {
+        uv_tcp_t* h = new uv_tcp_t();
+        h->data = new callbacks();
+        uv_tcp_init(l.get(), h);
+        callbacks::store(h->data, internal::uv_cid_read_start, read_callback_t([h](const char*, ssize_t) {}));
+        callbacks::store(h->data, internal::uv_cid_close, Callback([] {}));
+        uv_close(reinterpret_cast<uv_handle_t*>(h), [](uv_handle_t* h)
+        {
+            callbacks::invoke<Callback>(h->data, internal::uv_cid_close);
+            delete reinterpret_cast<callbacks*>(h->data);
+            delete reinterpret_cast<uv_tcp_t*>(h);
+        });
+    }
+    l.run();
+    return static_cast<double>(bench::allocations() - before) / connections;
+}
+
+double allocations_slots(loop& l)
+{
+    const size_t before = bench::allocations();
+    for (size_t i = 0; i < connections; ++i)
+    {
+        Tcp tcp(l);
+        Tcp* t = &tcp;
+        tcp.read_start([t](const char*, ssize_t) {}); // not connected, only installs the callback
+        tcp.close([] {});
+    }
+    l.run();
+    return static_cast<double>(bench::allocations() - before) / connections;
+}
+}
+
+int main()
+{
+    loop l;
+
+    std::cout << "dispatch (ns/dispatch)" << std::endl;
+    std::cout << "  callbacks, dynamic_cast:          " << dispatch_legacy() << std::endl;
+    std::cout << "  callback_slots, std::function:    " << dispatch_slots(read_callback_t([](const char* p, ssize_t len) { bench::do_not_optimize(p + len); })) << std::endl;
+    std::cout << "  callback_slots, lambda:           " << dispatch_slots([](const char* p, ssize_t len) { bench::do_not_optimize(p + len); }) << std::endl;
+
+    internal::callback_counters counters;
+    internal::dispatch_hooks metrics;
+    metrics.counters = &counters;
+    std::cout << "dispatch through a handle (ns/dispatch)" << std::endl;
+    std::cout << "  no metrics:                       " << dispatch_hooked(l, nullptr) << std::endl;
+    std::cout << "  metrics:                          " << dispatch_hooked(l, &metrics) << std::endl;
+    std::cout << "  metrics, slow callbacks:          " << dispatch_detector(l, 1) << std::endl;
+    std::cout << "  metrics, slow callbacks 1/64:     " << dispatch_detector(l, 64) << std::endl;
+
+    std::cout << "heap allocations per accepted Tcp (read + close callbacks installed)" << std::endl;
+    std::cout << "  callbacks:                        " << allocations_legacy(l) << std::endl;
+    std::cout << "  callback_slots:                   " << allocations_slots(l) << std::endl;
+    return 0;
+}
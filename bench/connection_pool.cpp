@@ -0,0 +1,203 @@
+/**
+ * Request latency against a local echo server, opening a connection per request against leasing
+ * one from a connection_pool. Clients run concurrently on the server's loop, each sending a request
+ * and waiting for the whole echo before sending the next. Reports requests/s and latency
+ * percentiles.
+ */
+#include <uv.h>
+#include "uvpp/connection_pool.hpp"
+#include "uvpp/metrics.hpp"
+#include "bench.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace uvpp;
+
+namespace {
+const size_t clients = 8;
+// small enough to stay clear of running out of ephemeral ports without the pool
+const size_t requests_per_client = 1000;
+const size_t request_size = 64;
+
+class echo_server
+{
+public:
+    explicit echo_server(loop& l):
+        m_loop(l)
+        , m_server(l)
+        , m_port(0)
+    {
+        bench::check(m_server.bind("127.0.0.1", 0), "bind");
+        bool ip4 = true;
+        std::string ip;
+        bench::check(m_server.getsockname(ip4, ip, m_port), "getsockname");
+        m_server.listen([this](error err)
+        {
+            if (err)
+                return;
+            Tcp* conn = new Tcp(m_loop);
+            m_server.accept(*conn);
+            conn->read_start([conn](const char* buf, ssize_t len)
+            {
+                if (len < 0)
+                {
+                    conn->close([conn]() { delete conn; });
+                    return;
+                }
+                std::shared_ptr<std::string> echo = std::make_shared<std::string>(buf, static_cast<size_t>(len));
+                conn->write(*echo, [echo](error) {});
+            });
+        });
+    }
+
+    int port() const
+    {
+        return m_port;
+    }
+
+    void close()
+    {
+        m_server.close();
+    }
+
+private:
+    loop& m_loop;
+    Tcp m_server;
+    int m_port;
+};
+
+/// one request on an open connection, done(true) once the echo is back
+void request(Tcp& conn, const std::string& payload, std::function<void(bool ok)> done)
+{
+    std::shared_ptr<size_t> received = std::make_shared<size_t>(0);
+    conn.read_start([&conn, received, done, &payload](const char*, ssize_t len)
+    {
+        if (len < 0)
+        {
+            done(false);
+            return;
+        }
+        *received += static_cast<size_t>(len);
+        if (*received >= payload.size())
+        {
+            conn.read_stop();
+            done(true);
+        }
+    });
+    conn.write(payload, [](error) {});
+}
+
+/**
+ * Runs the clients, send(next) performs one request and calls next when done. finished is called
+ * once they're all done, to close what keeps the loop running.
+ */
+template<typename send_t>
+double run_clients(loop& l, latency_histogram& latency, send_t send, Callback finished)
+{
+    size_t done = 0;
+    bench::stopwatch sw;
+    double elapsed = 0;
+    std::function<void(size_t)> next = [&](size_t remaining)
+    {
+        if (! remaining)
+        {
+            if (++done == clients)
+            {
+                elapsed = sw.elapsed_s();
+                finished();
+            }
+            return;
+        }
+        const uint64_t start = uv_hrtime();
+        send([&, remaining, start]()
+        {
+            latency.record((uv_hrtime() - start) / 1000);
+            next(remaining - 1);
+        });
+    };
+    for (size_t i = 0; i < clients; ++i)
+        next(requests_per_client);
+    l.run();
+    return clients * requests_per_client / elapsed;
+}
+
+void report(const char* name, double requests_per_s, const latency_histogram& latency, uint64_t connects)
+{
+    std::cout << name << ": " << static_cast<size_t>(requests_per_s) << " requests/s, latency p50 "
+              << latency.percentile(0.5) << " us, p99 " << latency.percentile(0.99) << " us, max "
+              << latency.max() << " us, " << connects << " connects" << std::endl;
+}
+
+void without_pool()
+{
+    loop l;
+    echo_server server(l);
+    const std::string payload(request_size, 'x');
+    latency_histogram latency;
+    uint64_t connects = 0;
+
+    const double rate = run_clients(l, latency, [&](std::function<void()> next)
+    {
+        Tcp* conn = new Tcp(l);
+        conn->connect("127.0.0.1", server.port(), [&, conn, next](error err)
+        {
+            ++connects;
+            if (err)
+            {
+                conn->close([conn]() { delete conn; });
+                return;
+            }
+            conn->nodelay(true);
+            request(*conn, payload, [&, conn, next](bool)
+            {
+                conn->close([conn]() { delete conn; });
+                next();
+            });
+        });
+    }, [&]() { server.close(); });
+    report("connection per request", rate, latency, connects);
+}
+
+void with_pool()
+{
+    loop l;
+    echo_server server(l);
+    connection_pool pool(l);
+    const std::string payload(request_size, 'x');
+    latency_histogram latency;
+
+    const double rate = run_clients(l, latency, [&](std::function<void()> next)
+    {
+        pool.checkout("127.0.0.1", server.port(), [&, next](error err, connection_pool::lease conn)
+        {
+            if (err)
+                return;
+            std::shared_ptr<connection_pool::lease> leased = std::make_shared<connection_pool::lease>(std::move(conn));
+            request(**leased, payload, [leased, next](bool ok)
+            {
+                // giving the lease back replaces the read callback running this
+                std::function<void()> done = next;
+                if (ok)
+                    leased->release();
+                else
+                    leased->reset();
+                done();
+            });
+        });
+    }, [&]()
+    {
+        pool.close();
+        server.close();
+    });
+    report("connection_pool", rate, latency, pool.connects());
+}
+}
+
+int main()
+{
+    without_pool();
+    with_pool();
+    return 0;
+}
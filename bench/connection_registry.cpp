@@ -0,0 +1,128 @@
+/**
+ * Connection tables at 10k, 100k and 1M connections: a std::map keyed by "tcp://ip:port" strings,
+ * as test/Server had, against a connection_registry keyed by ids. Reports the cost of registering
+ * a connection as on accept, of a lookup as for each send, and of erase + insert as connections
+ * come and go.
+ */
+#include <uv.h>
+#include "uvpp/connection_registry.hpp"
+#include "uvpp/net.hpp"
+#include "bench.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace uvpp;
+
+namespace {
+const size_t lookups = 2000000;
+
+/// stands in for a connection's state
+struct connection
+{
+    explicit connection(size_t n):
+        sent(n)
+    {
+    }
+
+    uint64_t sent;
+    char state[56];
+};
+
+endpoint peer(size_t i)
+{
+    sockaddr_in addr = sockaddr_in();
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(static_cast<uint32_t>(0x0a000000 + i / 50000));
+    addr.sin_port = htons(static_cast<uint16_t>(10000 + i % 50000));
+    return endpoint(reinterpret_cast<const sockaddr*>(&addr));
+}
+
+void report(const char* name, size_t n, double insert_ns, double lookup_ns, double churn_ns)
+{
+    std::cout << name << " " << n << ": insert " << insert_ns << " ns, lookup " << lookup_ns
+              << " ns, erase+insert " << churn_ns << " ns" << std::endl;
+}
+
+void string_map(size_t n, const std::vector<size_t>& order)
+{
+    std::map<std::string, std::unique_ptr<connection>> table;
+    std::vector<std::string> keys;
+    keys.reserve(n);
+
+    bench::stopwatch insert;
+    for (size_t i = 0; i < n; ++i)
+    {
+        std::string key = "tcp://" + peer(i).to_string();
+        table.emplace(key, std::unique_ptr<connection>(new connection(i)));
+        keys.push_back(std::move(key));
+    }
+    const double insert_ns = insert.elapsed_ns() / n;
+
+    bench::stopwatch lookup;
+    uint64_t sum = 0;
+    for (size_t i : order)
+        sum += table.find(keys[i])->second->sent;
+    bench::do_not_optimize(sum);
+    const double lookup_ns = lookup.elapsed_ns() / order.size();
+
+    const size_t churn = std::min<size_t>(n, 100000);
+    bench::stopwatch erase;
+    for (size_t i = 0; i < churn; ++i)
+    {
+        const size_t k = order[i];
+        table.erase(keys[k]);
+        table.emplace(keys[k], std::unique_ptr<connection>(new connection(k)));
+    }
+    report("std::map<std::string>", n, insert_ns, lookup_ns, erase.elapsed_ns() / churn);
+}
+
+void registry(size_t n, const std::vector<size_t>& order)
+{
+    connection_registry<connection> table;
+    std::vector<connection_registry<connection>::id_type> ids;
+    ids.reserve(n);
+
+    bench::stopwatch insert;
+    for (size_t i = 0; i < n; ++i)
+        ids.push_back(table.emplace(i));
+    const double insert_ns = insert.elapsed_ns() / n;
+
+    bench::stopwatch lookup;
+    uint64_t sum = 0;
+    for (size_t i : order)
+        sum += table.get(ids[i])->sent;
+    bench::do_not_optimize(sum);
+    const double lookup_ns = lookup.elapsed_ns() / order.size();
+
+    const size_t churn = std::min<size_t>(n, 100000);
+    bench::stopwatch erase;
+    for (size_t i = 0; i < churn; ++i)
+    {
+        const size_t k = order[i];
+        table.erase(ids[k]);
+        ids[k] = table.emplace(k);
+    }
+    report("connection_registry", n, insert_ns, lookup_ns, erase.elapsed_ns() / churn);
+}
+}
+
+int main()
+{
+    for (size_t n : { 10000, 100000, 1000000 })
+    {
+        // sends go to connections in no particular order
+        std::mt19937 rng(42);
+        std::vector<size_t> order(lookups);
+        for (size_t& i : order)
+            i = rng() % n;
+        string_map(n, order);
+        registry(n, order);
+    }
+    return 0;
+}
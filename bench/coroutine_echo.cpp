@@ -0,0 +1,179 @@
+/**
+ * Echo server written with coroutines against the same server written with callbacks, both doing
+ * read, write the bytes back, read again, driven by ping-pong clients on the same loop. Reports
+ * requests/s and heap allocations per request.
+ */
+#include <uv.h>
+#include "uvpp/coroutine.hpp"
+#include "bench.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace uvpp;
+
+namespace {
+const size_t connections = 64;
+const size_t requests_per_connection = 20000;
+const size_t request_size = 64;
+const size_t buffer_size = 4096;
+
+co::task<> echo(std::unique_ptr<Tcp> conn)
+{
+    char buf[buffer_size];
+    for (;;)
+    {
+        const ssize_t len = co_await co::read(*conn, buf, sizeof(buf));
+        if (len < 0)
+            break;
+        if (co_await co::write(*conn, buf, static_cast<size_t>(len)))
+            break;
+    }
+    conn->close();
+}
+
+/// the callback version of echo
+class echo_connection
+{
+public:
+    explicit echo_connection(loop& l):
+        m_tcp(l)
+    {
+    }
+
+    void start()
+    {
+        m_tcp.read_start_into([this](size_t)
+        {
+            return uv_buf_t { m_buf, sizeof(m_buf) };
+        },
+        [this](const char*, ssize_t len)
+        {
+            if (len < 0)
+            {
+                m_tcp.close([this]() { delete this; });
+                return;
+            }
+            m_tcp.read_stop();
+            m_tcp.write(m_buf, static_cast<int>(len), [this](error err)
+            {
+                if (err)
+                    m_tcp.close([this]() { delete this; });
+                else
+                    start();
+            });
+        });
+    }
+
+    Tcp m_tcp;
+
+private:
+    char m_buf[buffer_size];
+};
+
+struct result
+{
+    double requests_per_s;
+    double allocations_per_request;
+};
+
+template<typename accept_t>
+result run(accept_t accept)
+{
+    loop l;
+    Tcp server(l);
+    bench::check(server.bind("127.0.0.1", 0), "bind");
+    bool ip4 = true;
+    std::string ip;
+    int port = 0;
+    bench::check(server.getsockname(ip4, ip, port), "getsockname");
+    server.listen([&](error err)
+    {
+        if (! err)
+            accept(l, server);
+    });
+
+    const std::string request(request_size, 'x');
+    const size_t total = connections * requests_per_connection;
+    size_t done = 0;
+    size_t connected = 0;
+    size_t allocations = 0;
+    bench::stopwatch sw;
+    double elapsed = 0;
+
+    std::vector<std::unique_ptr<Tcp>> clients;
+    std::vector<size_t> received(connections, 0);
+    std::vector<size_t> answered(connections, 0);
+    for (size_t i = 0; i < connections; ++i)
+    {
+        clients.emplace_back(new Tcp(l));
+        Tcp& c = *clients.back();
+        c.connect(ip, port, [&, i](error err)
+        {
+            bench::check(! err, "connect");
+            c.read_start([&, i](const char*, ssize_t len)
+            {
+                if (len < 0)
+                    return;
+                received[i] += static_cast<size_t>(len);
+                while (received[i] >= request_size)
+                {
+                    received[i] -= request_size;
+                    ++done;
+                    if (++answered[i] < requests_per_connection)
+                        c.write(request, [](error) {});
+                    else
+                        c.close();
+                }
+                if (done == total)
+                {
+                    elapsed = sw.elapsed_s();
+                    allocations = bench::allocations() - allocations;
+                    server.close();
+                }
+            });
+            // start measuring once every connection is up
+            if (++connected == connections)
+            {
+                allocations = bench::allocations();
+                sw = bench::stopwatch();
+                for (std::unique_ptr<Tcp>& client : clients)
+                    client->write(request, [](error) {});
+            }
+        });
+    }
+    l.run();
+    return result { total / elapsed, static_cast<double>(allocations) / total };
+}
+
+void report(const char* name, const result& r)
+{
+    std::cout << name << ": " << static_cast<size_t>(r.requests_per_s) << " requests/s, "
+              << r.allocations_per_request << " allocations/request" << std::endl;
+}
+}
+
+int main()
+{
+    report("callbacks", run([](loop& l, Tcp& server)
+    {
+        echo_connection* conn = new echo_connection(l);
+        server.accept(conn->m_tcp);
+        conn->start();
+    }));
+
+    auto coroutine = [](loop& l, Tcp& server)
+    {
+        std::unique_ptr<Tcp> conn(new Tcp(l));
+        server.accept(*conn);
+        co::spawn(echo(std::move(conn)));
+    };
+    report("coroutines", run(coroutine));
+
+    co::frame_pool frames;
+    co::set_frame_allocator(&frames);
+    report("coroutines, frame_pool", run(coroutine));
+    co::set_frame_allocator(nullptr);
+    return 0;
+}
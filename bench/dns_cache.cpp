@@ -0,0 +1,156 @@
+/**
+ * Bursts of lookups of a few host names, like many connects to the same upstreams, resolved
+ * directly and through a dns_cache. A stub resolver completing on the next loop iteration
+ * counts the lookups reaching it, then uv_getaddrinfo of localhost shows the threadpool side.
+ */
+#include <uv.h>
+#include "uvpp/dns_cache.hpp"
+#include "uvpp/idle.hpp"
+#include "bench.h"
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace uvpp;
+
+namespace {
+const size_t hosts = 32;
+const size_t burst = 1000;
+const size_t bursts = 200;
+
+/// resolves host-<n> to 10.0.0.<n> on the next loop iteration
+class stub_resolver
+{
+public:
+    explicit stub_resolver(loop& l):
+        m_idle(l, [this]() { flush(); })
+        , m_calls(0)
+    {
+    }
+
+    void resolve(const std::string& host, dns_cache::resolved_callback done)
+    {
+        ++m_calls;
+        if (m_queue.empty())
+            m_idle.start();
+        m_queue.emplace_back(host, std::move(done));
+    }
+
+    dns_cache::resolver_function function()
+    {
+        return [this](const std::string& host, dns_cache::resolved_callback done) { resolve(host, std::move(done)); };
+    }
+
+    size_t calls() const
+    {
+        return m_calls;
+    }
+
+    void close()
+    {
+        m_idle.close();
+    }
+
+private:
+    void flush()
+    {
+        m_idle.stop();
+        std::vector<std::pair<std::string, dns_cache::resolved_callback>> queue;
+        queue.swap(m_queue);
+        for (auto& q : queue)
+        {
+            sockaddr_in addr;
+            uv_ip4_addr(("10.0.0." + q.first.substr(5)).c_str(), 0, &addr);
+            sockaddr_storage storage = sockaddr_storage();
+            memcpy(&storage, &addr, sizeof(addr));
+            q.second(error(0), address_list(1, storage));
+        }
+    }
+
+    Idle m_idle;
+    size_t m_calls;
+    std::vector<std::pair<std::string, dns_cache::resolved_callback>> m_queue;
+};
+
+std::string host_name(size_t i)
+{
+    return "host-" + std::to_string(i % hosts);
+}
+
+/// issues the bursts of lookups through resolve, each burst once the previous one completed
+template<typename resolve_t>
+double run(loop& l, size_t& resolved, resolve_t resolve)
+{
+    bench::stopwatch sw;
+    for (size_t b = 0; b < bursts; ++b)
+    {
+        const size_t target = resolved + burst;
+        for (size_t i = 0; i < burst; ++i)
+            resolve(host_name(i * 7 + b));
+        while (resolved < target)
+            l.run_once();
+    }
+    return burst * bursts / sw.elapsed_s();
+}
+
+void stub_direct()
+{
+    loop l;
+    stub_resolver stub(l);
+    size_t resolved = 0;
+    const double rate = run(l, resolved, [&](const std::string& host)
+    {
+        stub.resolve(host, [&](error, address_list) { ++resolved; });
+    });
+    std::cout << "stub, no cache: " << static_cast<size_t>(rate) << " lookups/s, "
+              << stub.calls() << " resolver calls" << std::endl;
+    stub.close();
+    l.run();
+}
+
+void stub_cached()
+{
+    loop l;
+    stub_resolver stub(l);
+    dns_cache cache(l, stub.function());
+    size_t resolved = 0;
+    const double rate = run(l, resolved, [&](const std::string& host)
+    {
+        cache.resolve(host, [&](error, const address_list&) { ++resolved; });
+    });
+    std::cout << "stub, dns_cache: " << static_cast<size_t>(rate) << " lookups/s, "
+              << stub.calls() << " resolver calls, hit rate " << cache.hit_rate() << " ("
+              << cache.hits() << " hits, " << cache.coalesced() << " coalesced)" << std::endl;
+    stub.close();
+    l.run();
+}
+
+void getaddrinfo(bool cached)
+{
+    loop l;
+    dns_cache cache(l);
+    dns_cache::resolver_function direct = dns_cache::getaddrinfo_resolver(l);
+    size_t resolved = 0;
+    size_t failed = 0;
+    const double rate = run(l, resolved, [&](const std::string&)
+    {
+        if (cached)
+            cache.resolve("localhost", [&](error err, const address_list&) { failed += err ? 1 : 0; ++resolved; });
+        else
+            direct("localhost", [&](error err, address_list) { failed += err ? 1 : 0; ++resolved; });
+    });
+    std::cout << "getaddrinfo, " << (cached ? "dns_cache" : "no cache") << ": "
+              << static_cast<size_t>(rate) << " lookups/s, " << failed << " failed" << std::endl;
+}
+}
+
+int main()
+{
+    stub_direct();
+    stub_cached();
+    getaddrinfo(false);
+    getaddrinfo(true);
+    return 0;
+}
@@ -0,0 +1,141 @@
+/**
+ * Tasks/s posted to a loop from 1 to 16 producer threads: loop_executor, unbounded and bounded,
+ * against a mutex guarded std::deque plus an Async, the pattern of test/Server.
+ */
+#include <uv.h>
+#include "uvpp/loop_executor.hpp"
+#include "bench.h"
+
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace uvpp;
+
+namespace {
+const size_t total_tasks = 1 << 21;
+
+/// the baseline, the consumer runs the tasks holding the lock
+class locked_queue
+{
+public:
+    explicit locked_queue(loop& l):
+        m_async(l, [this]() { drain(); })
+    {
+    }
+
+    template<typename F>
+    void post(F&& f)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_tasks.emplace_back(std::forward<F>(f));
+        m_async.send();
+    }
+
+    void close()
+    {
+        m_async.close();
+    }
+
+private:
+    void drain()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        while (! m_tasks.empty())
+        {
+            m_tasks.front()();
+            m_tasks.pop_front();
+        }
+    }
+
+    std::mutex m_lock;
+    std::deque<std::function<void()>> m_tasks;
+    Async m_async;
+};
+
+struct executor_factory
+{
+    size_t capacity;
+
+    std::unique_ptr<loop_executor> operator()(loop& l) const
+    {
+        return std::unique_ptr<loop_executor>(new loop_executor(l, capacity));
+    }
+};
+
+struct locked_factory
+{
+    std::unique_ptr<locked_queue> operator()(loop& l) const
+    {
+        return std::unique_ptr<locked_queue>(new locked_queue(l));
+    }
+};
+
+template<typename factory_t>
+double run(size_t producers, factory_t make)
+{
+    loop l;
+    auto queue = make(l);
+    auto* q = queue.get();
+    const size_t expected = total_tasks / producers * producers;
+    size_t done = 0;
+    bool posted = false;
+    // every post has to return before closing, so the producers are joined before that
+    Async joined(l, [&]()
+    {
+        posted = true;
+        if (done == expected)
+        {
+            q->close();
+            joined.close();
+        }
+    });
+
+    bench::stopwatch sw;
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&done, &posted, &joined, q, expected, producers]()
+        {
+            for (size_t i = 0; i < expected / producers; ++i)
+            {
+                q->post([&done, &posted, &joined, q, expected]()
+                {
+                    if (++done == expected && posted)
+                    {
+                        q->close();
+                        joined.close();
+                    }
+                });
+            }
+        });
+    }
+    std::thread joiner([&]()
+    {
+        for (std::thread& t : threads)
+            t.join();
+        joined.send();
+    });
+    l.run();
+    const double elapsed = sw.elapsed_s();
+    joiner.join();
+    return done / elapsed;
+}
+}
+
+int main()
+{
+    const size_t producers[] = { 1, 2, 4, 8, 16 };
+    for (size_t p : producers)
+    {
+        const double unbounded = run(p, executor_factory { 0 });
+        const double bounded = run(p, executor_factory { 65536 });
+        const double locked = run(p, locked_factory());
+        std::cout << p << " producers: loop_executor " << static_cast<size_t>(unbounded)
+                  << " tasks/s, bounded " << static_cast<size_t>(bounded)
+                  << " tasks/s, mutex+deque " << static_cast<size_t>(locked) << " tasks/s" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,241 @@
+/**
+ * A 1 KB message pushed to 10k loopback connections, writing a copy of it per stream as with the
+ * std::string write against fanout of one shared_buffer. Reports the time to queue the message on
+ * every stream, the time until every client received it, and the heap allocated meanwhile.
+ *
+ * Then a share of the clients stop reading while messages keep coming, showing how much the write
+ * queues grow with each slow_policy.
+ *
+ * Both ends of each connection are in the process, which needs 20k descriptors: the soft limit is
+ * raised to the hard one and the connections are cut down to what fits.
+ */
+#include <uv.h>
+#include "uvpp/fanout.hpp"
+#include "uvpp/tcp.hpp"
+#include "bench.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+using namespace uvpp;
+
+namespace {
+const size_t wanted_connections = 10000;
+const size_t message_size = 1024;
+const size_t rounds = 20;
+/// connects in flight while setting up
+const size_t connect_window = 256;
+
+const size_t slow_every = 10;
+const size_t slow_messages = 200;
+const size_t socket_buffer = 4096;
+
+size_t connections_possible()
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return wanted_connections;
+    if (limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    // two descriptors per connection, and some for the loop and the listener
+    const size_t fit = limit.rlim_cur > 64 ? (limit.rlim_cur - 64) / 2 : 0;
+    return std::min(wanted_connections, fit);
+}
+
+/// the server side of the connections, which the messages are written to, and their clients
+class bench_clients
+{
+public:
+    bench_clients(loop& l, size_t n):
+        m_loop(l)
+        , m_server(l)
+        , m_received(0)
+    {
+        int port = 0;
+        bool ip4 = true;
+        std::string ip;
+        bench::check(m_server.bind("127.0.0.1", 0), "bind");
+        bench::check(m_server.getsockname(ip4, ip, port), "getsockname");
+        m_server.listen([this](error err)
+        {
+            if (err)
+                return;
+            std::unique_ptr<Tcp> conn(new Tcp(m_loop));
+            if (m_server.accept(*conn))
+                subscribers.push_back(std::move(conn));
+        }, 1024);
+
+        size_t started = 0;
+        size_t connected = 0;
+        while (connected < n)
+        {
+            for (; started < n && started - connected < connect_window; ++started)
+            {
+                clients.emplace_back(new Tcp(m_loop));
+                Tcp& client = *clients.back();
+                client.connect("127.0.0.1", port, [this, &client, &connected](error err)
+                {
+                    ++connected;
+                    if (! err)
+                        client.read_start([this](const char*, ssize_t len) { if (len > 0) m_received += static_cast<size_t>(len); });
+                });
+            }
+            m_loop.run_once();
+        }
+        while (subscribers.size() < clients.size())
+            m_loop.run_once();
+        m_server.close();
+    }
+
+    ~bench_clients()
+    {
+        for (std::unique_ptr<Tcp>& c : clients)
+            c->close();
+        for (std::unique_ptr<Tcp>& s : subscribers)
+            s->close();
+        m_loop.run();
+    }
+
+    /// runs the loop until expected bytes more were received
+    void wait_received(size_t expected)
+    {
+        const size_t target = m_received + expected;
+        while (m_received < target)
+            m_loop.run_once();
+    }
+
+    /// bytes waiting in the write queues of the subscribers
+    size_t queued() const
+    {
+        size_t bytes = 0;
+        for (const std::unique_ptr<Tcp>& s : subscribers)
+        {
+            if (! uv_is_closing(s->get<uv_handle_t>()))
+                bytes += s->write_queue_size();
+        }
+        return bytes;
+    }
+
+    std::vector<std::unique_ptr<Tcp>> subscribers;
+    std::vector<std::unique_ptr<Tcp>> clients;
+
+private:
+    loop& m_loop;
+    Tcp m_server;
+    size_t m_received;
+};
+
+struct round_stats
+{
+    double queue_ms;
+    double delivered_ms;
+    size_t allocations;
+    size_t bytes;
+};
+
+round_stats median(std::vector<round_stats> stats)
+{
+    std::sort(stats.begin(), stats.end(), [](const round_stats& a, const round_stats& b) { return a.delivered_ms < b.delivered_ms; });
+    return stats[stats.size() / 2];
+}
+
+/// the rounds of one way of sending, send(message) queues it on every subscriber
+template<typename send_t>
+void broadcast_rounds(const char* name, bench_clients& clients, send_t send)
+{
+    const std::string message(message_size, 'x');
+    // the first round grows the slab of write requests
+    send(message);
+    clients.wait_received(message_size * clients.subscribers.size());
+
+    std::vector<round_stats> stats;
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        const size_t allocations = bench::allocations();
+        const size_t bytes = bench::allocated_bytes();
+        bench::stopwatch sw;
+        send(message);
+        const double queue_ms = sw.elapsed_ns() / 1e6;
+        const size_t queue_allocations = bench::allocations() - allocations;
+        const size_t queue_bytes = bench::allocated_bytes() - bytes;
+        clients.wait_received(message_size * clients.subscribers.size());
+        stats.push_back(round_stats { queue_ms, sw.elapsed_ns() / 1e6, queue_allocations, queue_bytes });
+    }
+
+    const round_stats m = median(stats);
+    std::cout << name << ": queued in " << m.queue_ms << " ms, delivered in " << m.delivered_ms << " ms, "
+              << m.allocations << " allocations, " << m.bytes / 1024 << " KB allocated" << std::endl;
+}
+
+void broadcast(size_t n)
+{
+    loop l;
+    bench_clients clients(l, n);
+    std::cout << clients.subscribers.size() << " connections, " << message_size << " byte message" << std::endl;
+
+    broadcast_rounds("string copy per stream", clients, [&](const std::string& message)
+    {
+        for (std::unique_ptr<Tcp>& s : clients.subscribers)
+        {
+            std::shared_ptr<std::string> copy = std::make_shared<std::string>(message);
+            s->write(*copy, [copy](error) {});
+        }
+    });
+
+    broadcast_rounds("fanout of a shared_buffer", clients, [&](const std::string& message)
+    {
+        fanout(clients.subscribers.begin(), clients.subscribers.end(), shared_buffer(message));
+    });
+}
+
+void slow_subscribers(size_t n, slow_policy policy, const char* name)
+{
+    loop l;
+    bench_clients clients(l, n);
+    size_t slow = 0;
+    for (size_t i = 0; i < clients.clients.size(); i += slow_every)
+    {
+        // small buffers so that the kernel soon stops taking what nobody reads
+        int size = socket_buffer;
+        uv_recv_buffer_size(clients.clients[i]->get<uv_handle_t>(), &size);
+        size = socket_buffer;
+        uv_send_buffer_size(clients.subscribers[i]->get<uv_handle_t>(), &size);
+        clients.clients[i]->read_stop();
+        ++slow;
+    }
+
+    fanout_options opts;
+    opts.max_queued = 16 * 1024;
+    opts.policy = policy;
+    const std::string message(message_size, 'x');
+    fanout_result total;
+    for (size_t m = 0; m < slow_messages; ++m)
+    {
+        const fanout_result r = fanout(clients.subscribers.begin(), clients.subscribers.end(), shared_buffer(message), opts,
+                                       [](std::unique_ptr<Tcp>& s) { s->close(); });
+        total.queued += r.queued;
+        total.skipped += r.skipped;
+        total.dropped += r.dropped;
+        l.run_nowait();
+    }
+    std::cout << name << ": " << slow << " slow subscribers, " << total.queued << " writes, " << total.skipped
+              << " skipped, " << total.dropped << " dropped, " << clients.queued() / 1024 << " KB left queued" << std::endl;
+}
+}
+
+int main()
+{
+    const size_t n = connections_possible();
+    broadcast(n);
+    slow_subscribers(n, slow_policy::queue, "slow_policy::queue");
+    slow_subscribers(n, slow_policy::skip, "slow_policy::skip");
+    slow_subscribers(n, slow_policy::drop, "slow_policy::drop");
+    return 0;
+}
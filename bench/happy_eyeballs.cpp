@@ -0,0 +1,127 @@
+/**
+ * Connect latency to a host with two addresses when the first one doesn't answer: a listener on
+ * 127.0.0.2 whose accept queue is full drops the SYNs like a blackholed address, 127.0.0.1 accepts.
+ * Connecting to the addresses in turn with a connect timeout against connect_any racing them.
+ */
+#include <uv.h>
+#include "uvpp/happy_eyeballs.hpp"
+#include "uvpp/timer.hpp"
+#include "bench.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace uvpp;
+
+namespace {
+const size_t rounds = 5;
+
+sockaddr_storage address(const char* ip)
+{
+    sockaddr_in addr;
+    uv_ip4_addr(ip, 0, &addr);
+    sockaddr_storage storage = sockaddr_storage();
+    memcpy(&storage, &addr, sizeof(addr));
+    return storage;
+}
+
+void report(const char* name, std::vector<double> ms)
+{
+    std::sort(ms.begin(), ms.end());
+    std::cout << name << ": median " << ms[ms.size() / 2] << " ms, max " << ms.back() << " ms" << std::endl;
+}
+}
+
+int main()
+{
+    loop l;
+    // both listeners on the same port, neither accepts: the backlog of the good one holds the few connections made
+    Tcp good(l);
+    bench::check(good.bind("127.0.0.1", 0), "bind");
+    bool ip4 = true;
+    std::string ip;
+    int port = 0;
+    bench::check(good.getsockname(ip4, ip, port), "getsockname");
+    good.listen([](error) {});
+    Tcp stalled(l);
+    if (! stalled.bind("127.0.0.2", port))
+    {
+        std::cout << "127.0.0.2 unavailable" << std::endl;
+        return 1;
+    }
+    stalled.listen([](error) {}, 0);
+
+    // fills the accept queue of the stalled listener
+    std::vector<std::unique_ptr<Tcp>> fill;
+    for (size_t i = 0; i < 2; ++i)
+    {
+        fill.emplace_back(new Tcp(l));
+        fill.back()->connect("127.0.0.2", port, [](error) {});
+    }
+    for (size_t i = 0; i < 10; ++i)
+        l.run_nowait();
+
+    const address_list addresses { address("127.0.0.2"), address("127.0.0.1") };
+    std::vector<std::unique_ptr<Tcp>> conns;
+
+    // a client trying the addresses in turn, giving up on each after timeout
+    const unsigned timeout = 1000;
+    std::vector<double> sequential;
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        bench::stopwatch sw;
+        bool done = false;
+        std::unique_ptr<Tcp> first(new Tcp(l));
+        Timer timer(l);
+        first->connect("127.0.0.2", port, [&](error err)
+        {
+            if (! err)
+                done = true;
+        });
+        timer.start([&]()
+        {
+            first->close();
+            conns.emplace_back(new Tcp(l));
+            conns.back()->connect("127.0.0.1", port, [&](error) { done = true; });
+        }, std::chrono::milliseconds(timeout));
+        while (! done)
+            l.run_once();
+        sequential.push_back(sw.elapsed_s() * 1000);
+        timer.close();
+        if (! uv_is_closing(first->get<uv_handle_t>()))
+            first->close();
+        conns.push_back(std::move(first));
+    }
+    report("in turn, 1 s connect timeout", sequential);
+
+    for (unsigned delay : { 250u, 50u })
+    {
+        std::vector<double> raced;
+        for (size_t r = 0; r < rounds; ++r)
+        {
+            bench::stopwatch sw;
+            bool done = false;
+            connect_any(l, addresses, port, [&](error, std::unique_ptr<Tcp> conn)
+            {
+                if (conn)
+                    conns.push_back(std::move(conn));
+                done = true;
+            }, std::chrono::milliseconds(delay));
+            while (! done)
+                l.run_once();
+            raced.push_back(sw.elapsed_s() * 1000);
+        }
+        report(delay == 250 ? "connect_any, 250 ms delay" : "connect_any, 50 ms delay", raced);
+    }
+
+    for (std::unique_ptr<Tcp>& c : fill)
+        c->close();
+    for (std::unique_ptr<Tcp>& c : conns)
+        c->close();
+    good.close();
+    stalled.close();
+    l.run();
+    return 0;
+}
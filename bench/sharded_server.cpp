@@ -0,0 +1,167 @@
+/**
+ * Connections/s and echo requests/s of a sharded_server on loopback as the number of loops grows.
+ * Each loop count is driven by as many client threads, each with its own loop.
+ */
+#include <uv.h>
+#include "uvpp/sharded_server.hpp"
+#include "bench.h"
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace uvpp;
+
+namespace {
+const double seconds = 1.0;
+const size_t concurrent_connects = 32;
+const size_t connections_per_client = 64;
+const size_t request_size = 32;
+
+typedef std::list<std::unique_ptr<Tcp>> connections;
+
+/// echoes everything back, closing on EOF
+void serve(loop& l, Tcp& listener, connections& conns)
+{
+    conns.emplace_front(new Tcp(l));
+    connections::iterator it = conns.begin();
+    Tcp& conn = **it;
+    if (! listener.accept(conn))
+    {
+        conns.erase(it);
+        return;
+    }
+    conn.read_start_buffers([&conn, &conns, it](buffer buf, ssize_t len)
+    {
+        if (len < 0)
+        {
+            conn.close([&conns, it]() { conns.erase(it); });
+            return;
+        }
+        buf.remove_suffix(buf.size() - static_cast<size_t>(len));
+        conn.writev({ make_buf(buf.data(), buf.size()) }, [buf](error) {});
+    });
+}
+
+/// connects and disconnects, returns the connections completed
+size_t churn(int port)
+{
+    loop l;
+    bench::stopwatch sw;
+    size_t done = 0;
+    std::function<void()> connect_one = [&]()
+    {
+        Tcp* c = new Tcp(l);
+        c->connect("127.0.0.1", port, [&, c](error e)
+        {
+            if (! e)
+                ++done;
+            c->close([c]() { delete c; });
+            if (sw.elapsed_s() < seconds)
+                connect_one();
+        });
+    };
+    for (size_t i = 0; i < concurrent_connects; ++i)
+        connect_one();
+    l.run();
+    return done;
+}
+
+/// request/response over persistent connections, returns the responses received
+size_t requests(int port)
+{
+    loop l;
+    bench::stopwatch sw;
+    size_t done = 0;
+    const std::string request(request_size, 'x');
+    std::vector<std::unique_ptr<Tcp>> clients;
+    std::vector<size_t> received(connections_per_client, 0);
+    for (size_t i = 0; i < connections_per_client; ++i)
+    {
+        clients.emplace_back(new Tcp(l));
+        Tcp& c = *clients.back();
+        size_t& got = received[i];
+        c.connect("127.0.0.1", port, [&, i](error e)
+        {
+            if (e)
+            {
+                c.close();
+                return;
+            }
+            c.read_start([&](const char*, ssize_t len)
+            {
+                if (len < 0)
+                {
+                    c.close();
+                    return;
+                }
+                got += static_cast<size_t>(len);
+                while (got >= request_size)
+                {
+                    got -= request_size;
+                    ++done;
+                    if (sw.elapsed_s() < seconds)
+                        c.write(request, [](error) {});
+                    else
+                        c.close();
+                }
+            });
+            c.write(request, [](error) {});
+        });
+    }
+    l.run();
+    return done;
+}
+
+template<typename client_t>
+double measure(int port, size_t threads, client_t client)
+{
+    std::atomic<size_t> total(0);
+    std::vector<std::thread> clients;
+    bench::stopwatch sw;
+    for (size_t i = 0; i < threads; ++i)
+        clients.emplace_back([&]() { total += client(port); });
+    for (std::thread& t : clients)
+        t.join();
+    return total / sw.elapsed_s();
+}
+}
+
+int main()
+{
+    const size_t max_loops = std::max(4u, std::thread::hardware_concurrency());
+    for (size_t loops = 1; loops <= max_loops; loops *= 2)
+    {
+        sharded_server server(loops);
+        std::vector<connections> conns(loops);
+        server.on_stop([&](size_t index, loop&)
+        {
+            connections& cs = conns[index];
+            for (connections::iterator it = cs.begin(); it != cs.end(); ++it)
+                (*it)->close([&cs, it]() { cs.erase(it); });
+        });
+        error err = server.start("127.0.0.1", 0, [&](size_t index, loop& l, Tcp& listener, error e)
+        {
+            if (! e)
+                serve(l, listener, conns[index]);
+        });
+        if (err)
+        {
+            std::cerr << "start: " << err.str() << std::endl;
+            return 1;
+        }
+
+        const double connections_per_s = measure(server.port(), loops, churn);
+        const double requests_per_s = measure(server.port(), loops, requests);
+        std::cout << loops << " loops: " << static_cast<size_t>(connections_per_s) << " connections/s, "
+                  << static_cast<size_t>(requests_per_s) << " requests/s" << std::endl;
+
+        server.stop();
+        server.join();
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * Idle timeouts of 300k connections: heap memory and re-arm cost of one Timer per connection
+ * against a timer_wheel node embedded in each connection. Also checks the wheel fires them all.
+ */
+#include <uv.h>
+#include "uvpp/timer_wheel.hpp"
+#include "bench.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace uvpp;
+
+namespace {
+const size_t connections = 300000;
+const size_t rearms = 3;
+
+/// timeout between 30s and 31s, spread like the reads of many connections
+std::chrono::milliseconds timeout(size_t i)
+{
+    return std::chrono::milliseconds(30000 + (i * 7919) % 1000);
+}
+
+void timers()
+{
+    loop l;
+    const size_t bytes = bench::allocated_bytes();
+    std::vector<std::unique_ptr<Timer>> conns;
+    conns.reserve(connections);
+    const size_t reserved = bench::allocated_bytes() - bytes;
+    for (size_t i = 0; i < connections; ++i)
+    {
+        conns.emplace_back(new Timer(l));
+        conns.back()->start([] {}, timeout(i));
+    }
+    const double per_connection = static_cast<double>(bench::allocated_bytes() - bytes - reserved) / connections;
+
+    bench::stopwatch sw;
+    for (size_t r = 0; r < rearms; ++r)
+    {
+        for (size_t i = 0; i < connections; ++i)
+            conns[i]->start([] {}, timeout(i + r));
+    }
+    const double rearm_ns = sw.elapsed_ns() / (rearms * connections);
+
+    for (std::unique_ptr<Timer>& t : conns)
+        t->close();
+    l.run();
+    std::cout << "Timer per connection: " << per_connection << " heap bytes/connection, "
+              << rearm_ns << " ns/re-arm" << std::endl;
+}
+
+struct connection
+{
+    timer_wheel::node idle;
+};
+
+void wheel()
+{
+    loop l;
+    timer_wheel w(l);
+    std::vector<connection> conns(connections);
+    size_t fired = 0;
+    for (size_t i = 0; i < connections; ++i)
+    {
+        conns[i].idle.data = &fired;
+        conns[i].idle.run = [](timer_wheel::node* n) { ++*static_cast<size_t*>(n->data); };
+        w.arm(conns[i].idle, timeout(i));
+    }
+
+    bench::stopwatch sw;
+    for (size_t r = 0; r < rearms; ++r)
+    {
+        for (size_t i = 0; i < connections; ++i)
+            w.arm(conns[i].idle, timeout(i + r));
+    }
+    const double rearm_ns = sw.elapsed_ns() / (rearms * connections);
+    std::cout << "timer_wheel: " << sizeof(timer_wheel::node) << " bytes embedded/connection, "
+              << rearm_ns << " ns/re-arm" << std::endl;
+
+    // short timeouts to check that everything fires
+    for (size_t i = 0; i < connections; ++i)
+        w.arm(conns[i].idle, std::chrono::milliseconds(i % 200));
+    bench::stopwatch fire;
+    while (w.size())
+        l.run_once();
+    std::cout << "timer_wheel: fired " << fired << " of " << connections << " timeouts in "
+              << fire.elapsed_s() << " s" << std::endl;
+    w.close();
+    l.run();
+}
+}
+
+int main()
+{
+    timers();
+    wheel();
+    return 0;
+}
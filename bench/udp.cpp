@@ -0,0 +1,113 @@
+/**
+ * Loopback UDP throughput. Receive: rounds of datagrams queued on the socket and drained by the
+ * loop, one recvmsg per datagram against recvmmsg batches. Send: one try_send per datagram against
+ * try_send_batch. Reports datagrams/s.
+ */
+#include <uv.h>
+#include "uvpp/udp.hpp"
+#include "bench.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace uvpp;
+
+namespace {
+const size_t datagram_size = 64;
+/// small enough for the default socket receive buffer to hold a round
+const size_t round_size = 128;
+const size_t rounds = 4000;
+
+sockaddr_storage address_of(Udp& u)
+{
+    sockaddr_storage addr;
+    int len = sizeof(addr);
+    bench::check(uv_udp_getsockname(u.get(), reinterpret_cast<sockaddr*>(&addr), &len) == 0, "getsockname");
+    return addr;
+}
+
+void receive(unsigned recv_batch)
+{
+    loop l;
+    Udp receiver(l, recv_batch);
+    Udp sender(l);
+    bench::check(receiver.bind("127.0.0.1", 0), "bind");
+    bench::check(sender.bind("127.0.0.1", 0), "bind");
+    const sockaddr_storage to = address_of(receiver);
+
+    const std::string payload(datagram_size, 'x');
+    std::vector<datagram> batch(round_size, datagram { payload.data(), payload.size(), reinterpret_cast<const sockaddr*>(&to) });
+
+    size_t received = 0;
+    receiver.recv_start([&](const char*, ssize_t len, const sockaddr*, unsigned)
+    {
+        if (len > 0)
+            ++received;
+    });
+
+    double elapsed = 0;
+    size_t sent = 0;
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        const int n = sender.try_send_batch(batch.data(), batch.size());
+        if (n <= 0)
+            continue;
+        sent += static_cast<size_t>(n);
+        bench::stopwatch sw;
+        while (received < sent)
+            l.run_once();
+        elapsed += sw.elapsed_s();
+    }
+
+    receiver.close();
+    sender.close();
+    l.run();
+    std::cout << "receive, recv_batch " << recv_batch << (receiver.using_recvmmsg() ? " (recvmmsg)" : "")
+              << ": " << static_cast<size_t>(received / elapsed) << " datagrams/s" << std::endl;
+}
+
+template<typename send_t>
+void send(const char* name, send_t send_round)
+{
+    loop l;
+    Udp receiver(l);
+    Udp sender(l);
+    bench::check(receiver.bind("127.0.0.1", 0), "bind");
+    bench::check(sender.bind("127.0.0.1", 0), "bind");
+    const sockaddr_storage to = address_of(receiver);
+
+    // nobody reads: loopback drops what doesn't fit in the receive buffer, sends don't block
+    const std::string payload(datagram_size, 'x');
+    std::vector<datagram> batch(round_size, datagram { payload.data(), payload.size(), reinterpret_cast<const sockaddr*>(&to) });
+    size_t sent = 0;
+    bench::stopwatch sw;
+    for (size_t r = 0; r < rounds; ++r)
+        sent += send_round(sender, batch);
+    const double elapsed = sw.elapsed_s();
+
+    receiver.close();
+    sender.close();
+    l.run();
+    std::cout << "send, " << name << ": " << static_cast<size_t>(sent / elapsed) << " datagrams/s" << std::endl;
+}
+}
+
+int main()
+{
+    receive(1);
+    receive(16);
+
+    send("try_send", [](Udp& u, const std::vector<datagram>& batch)
+    {
+        size_t sent = 0;
+        for (const datagram& d : batch)
+            sent += u.try_send(d.data, d.len, d.addr) > 0 ? 1 : 0;
+        return sent;
+    });
+    send("try_send_batch", [](Udp& u, const std::vector<datagram>& batch)
+    {
+        const int n = u.try_send_batch(batch.data(), batch.size());
+        return n > 0 ? static_cast<size_t>(n) : 0;
+    });
+    return 0;
+}
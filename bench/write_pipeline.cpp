@@ -0,0 +1,99 @@
+/**
+ * Writes per second on a loopback Tcp keeping 1, 16 and 256 writes in flight.
+ */
+#include <uv.h>
+#include "uvpp/tcp.hpp"
+#include "bench.h"
+
+#include <iostream>
+#include <memory>
+
+using namespace uvpp;
+
+namespace {
+const size_t total_writes = 2000000;
+const size_t message_size = 64;
+
+struct result
+{
+    double writes_per_s;
+    double allocations_per_write;
+};
+
+result run(size_t outstanding)
+{
+    loop l;
+    Tcp server(l), client(l);
+    std::unique_ptr<Tcp> peer;
+    bench::check(server.bind("127.0.0.1", 0), "bind");
+    bool ip4 = true;
+    std::string ip;
+    int port = 0;
+    bench::check(server.getsockname(ip4, ip, port), "getsockname");
+
+    server.listen([&](error)
+    {
+        peer.reset(new Tcp(l));
+        server.accept(*peer);
+        peer->read_start([&](const char*, ssize_t len)
+        {
+            if (len < 0)
+            {
+                peer->close();
+                server.close();
+            }
+        });
+    });
+
+    const std::string message(message_size, 'x');
+    size_t issued = 0;
+    size_t completed = 0;
+    size_t allocations = 0;
+    bench::stopwatch sw;
+    double elapsed = 0;
+    std::function<void(error)> on_write;
+
+    std::function<void(error)> on_write_impl = [&](error e)
+    {
+        bench::check(! e, "write");
+        if (++completed == total_writes)
+        {
+            elapsed = sw.elapsed_s();
+            allocations = bench::allocations() - allocations;
+            client.shutdown([&](error) { client.close(); });
+        }
+        else if (issued < total_writes)
+        {
+            ++issued;
+            client.write(message, on_write);
+        }
+    };
+    // small enough for std::function to keep inline, so that copying it into write doesn't allocate
+    auto impl = &on_write_impl;
+    on_write = [impl](error e) { (*impl)(e); };
+
+    client.connect(ip, port, [&](error e)
+    {
+        bench::check(! e, "connect");
+        allocations = bench::allocations();
+        sw = bench::stopwatch();
+        for (; issued < outstanding; ++issued)
+            client.write(message, on_write);
+    });
+
+    l.run();
+    return result { total_writes / elapsed, static_cast<double>(allocations) / total_writes };
+}
+}
+
+int main()
+{
+    const size_t outstanding[] = { 1, 16, 256 };
+    for (size_t n : outstanding)
+    {
+        result r = run(n);
+        std::cout << n << " outstanding: " << static_cast<size_t>(r.writes_per_s) << " writes/s, "
+                  << r.allocations_per_write << " allocations/write" << std::endl;
+    }
+    return 0;
+}
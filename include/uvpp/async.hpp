@@ -5,15 +5,23 @@
 #include "loop.hpp"
 
 namespace uvpp {
+namespace internal {
+template<>
+struct handle_traits<uv_async_t>
+{
+    typedef callback_slots<uv_cid_close, uv_cid_async> callbacks_type;
+};
+}
+
 class Async : public handle<uv_async_t>
 {
 public:
-    Async(loop &l, Callback callback): handle<uv_async_t>(), loop_(l.get())
+    Async(loop &l, Callback callback): handle<uv_async_t>(l.get()), loop_(l.get())
     {
         init(callback);
     }
 
-    Async(Callback callback): handle<uv_async_t>(), loop_(uv_default_loop())
+    Async(Callback callback): handle<uv_async_t>(uv_default_loop()), loop_(uv_default_loop())
     {
         init(callback);
     }
@@ -27,11 +35,11 @@ private:
 
     error init(Callback callback)
     {
-        callbacks::store(get()->data, internal::uv_cid_async, callback);
+        slots(get()->data).store<internal::uv_cid_async>(callback);
 
         return error(uv_async_init(loop_, get(), [](uv_async_t* handle)
         {
-            callbacks::invoke<decltype(callback)>(handle->data, internal::uv_cid_async);
+            slots(handle->data).invoke<internal::uv_cid_async>();
         }));
     }
 
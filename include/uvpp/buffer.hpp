@@ -0,0 +1,154 @@
+#pragma once
+
+#include "pool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace uvpp {
+/**
+ * Reference counted view on a buffer of a buffer_pool. Copies and slices share the pooled
+ * buffer, which goes back to its pool when the last of them is released.
+ *
+ * Like the pool, buffers belong to the loop's thread and must be released before the loop is
+ * destroyed.
+ */
+class buffer
+{
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    buffer():
+        m_block(nullptr)
+        , m_data(nullptr)
+        , m_size(0)
+    {
+    }
+
+    buffer(const buffer& other):
+        m_block(other.m_block)
+        , m_data(other.m_data)
+        , m_size(other.m_size)
+    {
+        if (m_block)
+            buffer_pool::add_ref(m_block);
+    }
+
+    buffer(buffer&& other):
+        m_block(other.m_block)
+        , m_data(other.m_data)
+        , m_size(other.m_size)
+    {
+        other.m_block = nullptr;
+        other.m_data = nullptr;
+        other.m_size = 0;
+    }
+
+    buffer& operator=(buffer other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    ~buffer()
+    {
+        reset();
+    }
+
+    /**
+     * Takes over the reference of pooled_buf, obtained from buffer_pool::acquire, viewing its
+     * first size bytes
+     */
+    static buffer adopt(char* pooled_buf, size_t size)
+    {
+        return buffer(pooled_buf, pooled_buf, size);
+    }
+
+    const char* data() const
+    {
+        return m_data;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    const char* begin() const
+    {
+        return m_data;
+    }
+
+    const char* end() const
+    {
+        return m_data + m_size;
+    }
+
+    /// buffer sharing the pooled memory viewing len bytes from offset
+    buffer slice(size_t offset, size_t len = npos) const
+    {
+        assert(offset <= m_size);
+        len = std::min(len, m_size - offset);
+        if (m_block)
+            buffer_pool::add_ref(m_block);
+        return buffer(m_block, m_data + offset, len);
+    }
+
+    /// drops the first n bytes from the view
+    void remove_prefix(size_t n)
+    {
+        assert(n <= m_size);
+        m_data += n;
+        m_size -= n;
+    }
+
+    /// drops the last n bytes from the view
+    void remove_suffix(size_t n)
+    {
+        assert(n <= m_size);
+        m_size -= n;
+    }
+
+    /// number of buffers sharing the pooled memory
+    size_t use_count() const
+    {
+        return m_block ? buffer_pool::use_count(m_block) : 0;
+    }
+
+    void reset()
+    {
+        if (m_block)
+        {
+            char* block = m_block;
+            m_block = nullptr;
+            buffer_pool::unref(block);
+        }
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    void swap(buffer& other)
+    {
+        std::swap(m_block, other.m_block);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+    }
+
+private:
+    buffer(char* block, const char* data, size_t size):
+        m_block(block)
+        , m_data(data)
+        , m_size(size)
+    {
+    }
+
+    char* m_block;
+    const char* m_data;
+    size_t m_size;
+};
+}
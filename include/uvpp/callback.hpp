@@ -3,12 +3,19 @@
 #include <vector>
 #include <functional>
 #include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include "error.hpp"
 
 namespace uvpp {
 typedef std::function<void()> Callback;
 typedef std::function<void(error)> CallbackWithResult;
 
+struct Stats;
+class buffer;
+
 namespace internal {
 enum uv_callback_id
 {
@@ -39,9 +46,286 @@ enum uv_callback_id
     uv_cid_fs_event,
     uv_cid_fs_scandir,
     uv_cid_resolve,
+    uv_cid_read_buffer,
+    uv_cid_read_prepare,
+    uv_cid_drain,
+    uv_cid_congested,
+    uv_cid_udp_recv,
+    uv_cid_udp_send,
     uv_cid_max
 };
 
+/**
+ * Signature of the callback stored for each uv_callback_id
+ */
+template<int cid> struct callback_signature;
+
+template<> struct callback_signature<uv_cid_close> { typedef void type(); };
+template<> struct callback_signature<uv_cid_listen> { typedef void type(error); };
+template<> struct callback_signature<uv_cid_read_start> { typedef void type(const char*, ssize_t); };
+template<> struct callback_signature<uv_cid_write> { typedef void type(error); };
+template<> struct callback_signature<uv_cid_shutdown> { typedef void type(error); };
+template<> struct callback_signature<uv_cid_connect> { typedef void type(error); };
+template<> struct callback_signature<uv_cid_connect6> { typedef void type(error); };
+template<> struct callback_signature<uv_cid_work> { typedef void type(); };
+template<> struct callback_signature<uv_cid_after_work> { typedef void type(error); };
+template<> struct callback_signature<uv_cid_timer> { typedef void type(); };
+template<> struct callback_signature<uv_cid_poll> { typedef void type(int, int); };
+template<> struct callback_signature<uv_cid_signal> { typedef void type(int); };
+template<> struct callback_signature<uv_cid_async> { typedef void type(); };
+template<> struct callback_signature<uv_cid_idle> { typedef void type(); };
+template<> struct callback_signature<uv_cid_fs_open> { typedef void type(error, uv_file); };
+template<> struct callback_signature<uv_cid_fs_read> { typedef void type(ssize_t); };
+template<> struct callback_signature<uv_cid_fs_write> { typedef void type(error); };
+template<> struct callback_signature<uv_cid_fs_close> { typedef void type(); };
+template<> struct callback_signature<uv_cid_fs_unlink> { typedef void type(error); };
+template<> struct callback_signature<uv_cid_fs_stats> { typedef void type(error, Stats); };
+template<> struct callback_signature<uv_cid_fs_fsync> { typedef void type(error); };
+template<> struct callback_signature<uv_cid_fs_rename> { typedef void type(error); };
+template<> struct callback_signature<uv_cid_fs_sendfile> { typedef void type(error); };
+template<> struct callback_signature<uv_cid_fs_poll> { typedef void type(error, int, Stats, Stats); };
+template<> struct callback_signature<uv_cid_fs_event> { typedef void type(const char*, int, int); };
+template<> struct callback_signature<uv_cid_fs_scandir> { typedef void type(int); };
+template<> struct callback_signature<uv_cid_resolve> { typedef void type(const error&, bool, const std::string&); };
+template<> struct callback_signature<uv_cid_read_buffer> { typedef void type(buffer, ssize_t); };
+template<> struct callback_signature<uv_cid_read_prepare> { typedef uv_buf_t type(size_t); };
+template<> struct callback_signature<uv_cid_drain> { typedef void type(); };
+template<> struct callback_signature<uv_cid_congested> { typedef void type(); };
+template<> struct callback_signature<uv_cid_udp_recv> { typedef void type(const char*, ssize_t, const sockaddr*, unsigned); };
+template<> struct callback_signature<uv_cid_udp_send> { typedef void type(error); };
+
+template<typename Signature>
+struct signature_result;
+
+template<typename R, typename ...A>
+struct signature_result<R(A...)>
+{
+    typedef R type;
+};
+
+/**
+ * Type erased callable with small buffer storage.
+ *
+ * Callables up to Capacity bytes (a std::function plus a couple of captured pointers) are stored
+ * inline, bigger ones go to the heap. Dispatch is a call through a static table of function
+ * pointers, no RTTI involved.
+ */
+template<typename Signature, size_t Capacity = 6 * sizeof(void*)>
+class inline_callback;
+
+template<typename R, typename ...A, size_t Capacity>
+class inline_callback<R(A...), Capacity>
+{
+public:
+    inline_callback():
+        m_ops(nullptr)
+    {
+    }
+
+    inline_callback(inline_callback&& other):
+        m_ops(other.m_ops)
+    {
+        if (m_ops)
+        {
+            m_ops->move(&m_storage, &other.m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    inline_callback& operator=(inline_callback&& other)
+    {
+        if (this == &other)
+            return *this;
+        reset();
+        if (other.m_ops)
+        {
+            other.m_ops->move(&m_storage, &other.m_storage);
+            m_ops = other.m_ops;
+            other.m_ops = nullptr;
+        }
+        return *this;
+    }
+
+    inline_callback(const inline_callback&) = delete;
+    inline_callback& operator=(const inline_callback&) = delete;
+
+    ~inline_callback()
+    {
+        reset();
+    }
+
+    template<typename F>
+    void assign(F&& f)
+    {
+        typedef typename std::decay<F>::type functor_t;
+        reset();
+        construct<functor_t>(std::forward<F>(f), std::integral_constant<bool, fits<functor_t>::value>());
+    }
+
+    void reset()
+    {
+        if (m_ops)
+        {
+            const ops* o = m_ops;
+            m_ops = nullptr;
+            o->destroy(&m_storage);
+        }
+    }
+
+    explicit operator bool() const
+    {
+        return m_ops != nullptr;
+    }
+
+    R operator()(A... args)
+    {
+        assert(m_ops);
+        return m_ops->invoke(&m_storage, std::forward<A>(args)...);
+    }
+
+private:
+    typedef typename std::aligned_storage<Capacity, alignof(void*)>::type storage_t;
+
+    struct ops
+    {
+        R (*invoke)(void*, A...);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void*);
+    };
+
+    template<typename F>
+    struct fits : std::integral_constant<bool,
+        sizeof(F) <= sizeof(storage_t)
+        && alignof(F) <= alignof(storage_t)
+        && std::is_nothrow_move_constructible<F>::value>
+    {
+    };
+
+    template<typename F>
+    struct inline_ops
+    {
+        static R invoke(void* p, A... args)
+        {
+            return (*static_cast<F*>(p))(std::forward<A>(args)...);
+        }
+
+        static void move(void* dst, void* src)
+        {
+            new (dst) F(std::move(*static_cast<F*>(src)));
+            static_cast<F*>(src)->~F();
+        }
+
+        static void destroy(void* p)
+        {
+            static_cast<F*>(p)->~F();
+        }
+
+        static const ops table;
+    };
+
+    template<typename F>
+    struct heap_ops
+    {
+        static R invoke(void* p, A... args)
+        {
+            return (**static_cast<F**>(p))(std::forward<A>(args)...);
+        }
+
+        static void move(void* dst, void* src)
+        {
+            *static_cast<F**>(dst) = *static_cast<F**>(src);
+        }
+
+        static void destroy(void* p)
+        {
+            delete *static_cast<F**>(p);
+        }
+
+        static const ops table;
+    };
+
+    template<typename F, typename U>
+    void construct(U&& f, std::true_type)
+    {
+        new (&m_storage) F(std::forward<U>(f));
+        m_ops = &inline_ops<F>::table;
+    }
+
+    template<typename F, typename U>
+    void construct(U&& f, std::false_type)
+    {
+        *reinterpret_cast<F**>(&m_storage) = new F(std::forward<U>(f));
+        m_ops = &heap_ops<F>::table;
+    }
+
+    const ops* m_ops;
+    storage_t m_storage;
+};
+
+template<typename R, typename ...A, size_t Capacity>
+template<typename F>
+const typename inline_callback<R(A...), Capacity>::ops inline_callback<R(A...), Capacity>::inline_ops<F>::table = {
+    &inline_ops<F>::invoke, &inline_ops<F>::move, &inline_ops<F>::destroy
+};
+
+template<typename R, typename ...A, size_t Capacity>
+template<typename F>
+const typename inline_callback<R(A...), Capacity>::ops inline_callback<R(A...), Capacity>::heap_ops<F>::table = {
+    &heap_ops<F>::invoke, &heap_ops<F>::move, &heap_ops<F>::destroy
+};
+
+template<int cid, int ...cids>
+struct slot_index; // cid is not part of the slot table
+
+template<int cid, int ...rest>
+struct slot_index<cid, cid, rest...> : std::integral_constant<size_t, 0>
+{
+};
+
+template<int cid, int first, int ...rest>
+struct slot_index<cid, first, rest...> : std::integral_constant<size_t, 1 + slot_index<cid, rest...>::value>
+{
+};
+
+/**
+ * Fixed set of callback slots, one per uv_callback_id listed in cids, stored inline.
+ *
+ * Each wrapper declares the ids it uses through handle_traits, storing or invoking a callback id
+ * which is not in the set is a compile error.
+ */
+template<int ...cids>
+class callback_slots
+{
+public:
+    template<int cid>
+    struct slot
+    {
+        typedef inline_callback<typename callback_signature<cid>::type> type;
+        typedef typename signature_result<typename callback_signature<cid>::type>::type result_type;
+    };
+
+    template<int cid, typename callback_t>
+    void store(callback_t&& callback)
+    {
+        std::get<slot_index<cid, cids...>::value>(m_slots).assign(std::forward<callback_t>(callback));
+    }
+
+    template<int cid, typename ...A>
+    typename slot<cid>::result_type invoke(A&& ... args)
+    {
+        return std::get<slot_index<cid, cids...>::value>(m_slots)(std::forward<A>(args)...);
+    }
+
+    template<int cid>
+    typename slot<cid>::type& get()
+    {
+        return std::get<slot_index<cid, cids...>::value>(m_slots);
+    }
+
+private:
+    std::tuple<typename slot<cids>::type...> m_slots;
+};
+
 class callback_object_base
 {
 public:
@@ -95,6 +379,9 @@ typedef std::unique_ptr<internal::callback_object_base> callback_object_ptr;
 /**
  * Class that allows to install callback objects for each uv_callback_id value taking ownership
  * of the callback object which is copied.
+ *
+ * The wrappers use the typed internal::callback_slots instead, this runtime indexed table is kept
+ * for user code.
  */
 class callbacks
 {
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "async.hpp"
+#include "loop.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace uvpp {
+/**
+ * Async carrying values: send(T) may be called from any thread and the loop-side callback gets
+ * every value sent since it last ran, in send order, as one contiguous batch.
+ *
+ * libuv coalesces the wakeups of an Async, the channel doesn't lose values to that: senders push
+ * onto a lock-free list and only the one finding it empty wakes the loop, which takes the whole
+ * list at once. So there's one wakeup and one callback per batch however many values were sent.
+ *
+ * The batch vector is reused between callbacks, the callback may move the values out of it. Like
+ * handles the channel has to be closed, from the loop's thread, before it's destroyed, and only
+ * once every send has returned. Values not received then are dropped.
+ */
+template<typename T>
+class Channel
+{
+public:
+    typedef std::function<void(std::vector<T>& batch)> batch_callback;
+
+    Channel(loop& l, batch_callback callback):
+        m_head(nullptr)
+        , m_callback(std::move(callback))
+        , m_async(l, [this]() { receive(); })
+    {
+        assert(m_callback);
+    }
+
+    ~Channel()
+    {
+        free(m_head.exchange(nullptr));
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    /// any thread
+    error send(T value)
+    {
+        node* n = new node(std::move(value));
+        node* head = m_head.load(std::memory_order_relaxed);
+        do
+        {
+            n->next = head;
+        }
+        while (! m_head.compare_exchange_weak(head, n, std::memory_order_release, std::memory_order_relaxed));
+
+        // a non empty list has already woken the loop, which hasn't taken it yet
+        return head ? error(0) : m_async.send();
+    }
+
+    void close(Callback callback = [] {})
+    {
+        m_async.close(std::move(callback));
+    }
+
+private:
+    struct node
+    {
+        explicit node(T&& v):
+            next(nullptr)
+            , value(std::move(v))
+        {
+        }
+
+        node* next;
+        T value;
+    };
+
+    void receive()
+    {
+        node* n = m_head.exchange(nullptr, std::memory_order_acquire);
+        if (! n)
+            return;
+
+        // the list is newest first
+        m_batch.clear();
+        for (node* i = n; i; i = i->next)
+            m_batch.push_back(std::move(i->value));
+        free(n);
+        std::reverse(m_batch.begin(), m_batch.end());
+        m_callback(m_batch);
+    }
+
+    static void free(node* n)
+    {
+        while (n)
+        {
+            node* next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+
+    std::atomic<node*> m_head;
+    std::vector<T> m_batch;
+    batch_callback m_callback;
+    Async m_async;
+};
+}
@@ -0,0 +1,504 @@
+#pragma once
+
+#include "tcp.hpp"
+#include "timer_wheel.hpp"
+#include "loop.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <errno.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+namespace uvpp {
+/**
+ * Pool of client Tcp connections of a loop, keyed by the address and port of the upstream.
+ *
+ * checkout hands out a lease on a connection: an idle one when there is one, the most recently
+ * used first, else a new one while the host is under max_per_host connections, else the checkout
+ * waits in the host's queue for a connection to be released. A lease given back with release()
+ * goes to the next waiter or is kept idle for reuse, a lease destroyed without it closes its
+ * connection, which is what to do with a connection whose protocol state is unknown.
+ *
+ * Idle connections are read from so that the peer closing them, or sending anything unexpected,
+ * evicts them right away, and they're evicted after idle_timeout through a timer_wheel. On
+ * checkout a nonblocking peek at the socket catches what the loop hasn't seen yet, then the
+ * optional health_check runs.
+ *
+ * Like handles the pool has to be closed, and the loop run until close's callback, before it's
+ * destroyed.
+ */
+class connection_pool
+{
+public:
+    struct options
+    {
+        options():
+            max_per_host(8)
+            , max_idle_per_host(8)
+            , idle_timeout(std::chrono::seconds(30))
+            , keepalive_delay(60)
+            , nodelay(true)
+        {
+        }
+
+        /// connections open to one host, idle, leased or connecting
+        size_t max_per_host;
+        size_t max_idle_per_host;
+        std::chrono::milliseconds idle_timeout;
+        /// seconds of idleness before TCP keepalive probes, 0 disables them
+        unsigned keepalive_delay;
+        bool nodelay;
+        /// called on checkout of an idle connection, which is closed when it returns false
+        std::function<bool(Tcp&)> health_check;
+    };
+
+private:
+    struct host;
+
+    struct connection
+    {
+        connection(loop& l, host* h):
+            tcp(l)
+            , owner(h)
+        {
+        }
+
+        Tcp tcp;
+        host* owner;
+        timer_wheel::node idle;
+    };
+
+public:
+    /**
+     * A connection checked out of the pool, empty when the checkout failed
+     */
+    class lease
+    {
+    public:
+        lease():
+            m_pool(nullptr)
+            , m_conn(nullptr)
+        {
+        }
+
+        lease(lease&& other):
+            m_pool(other.m_pool)
+            , m_conn(other.m_conn)
+        {
+            other.m_conn = nullptr;
+        }
+
+        lease& operator=(lease&& other)
+        {
+            if (this != &other)
+            {
+                reset();
+                m_pool = other.m_pool;
+                m_conn = other.m_conn;
+                other.m_conn = nullptr;
+            }
+            return *this;
+        }
+
+        ~lease()
+        {
+            reset();
+        }
+
+        lease(const lease&) = delete;
+        lease& operator=(const lease&) = delete;
+
+        explicit operator bool() const
+        {
+            return m_conn != nullptr;
+        }
+
+        Tcp& operator*() const
+        {
+            assert(m_conn);
+            return m_conn->tcp;
+        }
+
+        Tcp* operator->() const
+        {
+            assert(m_conn);
+            return &m_conn->tcp;
+        }
+
+        /**
+         * Gives the connection back for reuse. Its reads are stopped, and its read callback
+         * replaced by the pool's or the next lease's, the writes issued must have completed and
+         * nothing must be left to read of the last response. When called from the connection's
+         * read callback, that callback may be destroyed: nothing it captured can be used
+         * afterwards.
+         */
+        void release()
+        {
+            if (m_conn)
+                m_pool->give_back(take());
+        }
+
+        /// closes the connection
+        void reset()
+        {
+            if (m_conn)
+                m_pool->discard(take());
+        }
+
+    private:
+        friend class connection_pool;
+
+        lease(connection_pool* pool, connection* conn):
+            m_pool(pool)
+            , m_conn(conn)
+        {
+        }
+
+        connection* take()
+        {
+            connection* conn = m_conn;
+            m_conn = nullptr;
+            return conn;
+        }
+
+        connection_pool* m_pool;
+        connection* m_conn;
+    };
+
+    /// err is set and the lease empty when connecting failed or the pool was closed
+    typedef std::function<void(error err, lease conn)> checkout_callback;
+
+    explicit connection_pool(loop& l, const options& opts = options()):
+        m_loop(l)
+        , m_options(opts)
+        , m_wheel(l, std::chrono::milliseconds(100))
+        , m_closing(0)
+        , m_closed(false)
+        , m_connects(0)
+        , m_reuses(0)
+    {
+        assert(m_options.max_per_host > 0);
+    }
+
+    connection_pool(const connection_pool&) = delete;
+    connection_pool& operator=(const connection_pool&) = delete;
+
+    /**
+     * callback is called right away when an idle connection can be reused or ip isn't a valid
+     * address, else once connected or once a connection is released by another lease. An ip
+     * containing ':' is IPv6.
+     */
+    void checkout(const std::string& ip, int port, checkout_callback callback)
+    {
+        assert(callback);
+        if (m_closed)
+        {
+            callback(error(UV_ECANCELED), lease());
+            return;
+        }
+
+        host* found = nullptr;
+        const int res = get_host(ip, port, found);
+        if (res != 0)
+        {
+            callback(error(res), lease());
+            return;
+        }
+        host& h = *found;
+        while (! h.idle.empty())
+        {
+            connection* c = h.idle.back();
+            h.idle.pop_back();
+            unwatch(*c);
+            if (healthy(*c))
+            {
+                ++m_reuses;
+                callback(error(0), lease(this, c));
+                return;
+            }
+            destroy(c);
+        }
+
+        if (h.open < m_options.max_per_host)
+            connect(h, std::move(callback));
+        else
+            h.waiting.push_back(std::move(callback));
+    }
+
+    /**
+     * Fails the waiting checkouts with UV_ECANCELED and closes the idle connections and those
+     * still connecting, whose checkouts fail with UV_ECANCELED too. The leased ones are closed as
+     * they're given back or reset. callback is called once all of them and the pool's timer are
+     * closed, from then on the pool can be destroyed.
+     */
+    void close(Callback callback = [] {})
+    {
+        if (m_closed)
+            return;
+        m_closed = true;
+        m_on_closed = std::move(callback);
+
+        for (auto& entry : m_hosts)
+        {
+            host& h = *entry.second;
+            std::deque<checkout_callback> waiting;
+            waiting.swap(h.waiting);
+            for (checkout_callback& w : waiting)
+                w(error(UV_ECANCELED), lease());
+            while (! h.idle.empty())
+            {
+                connection* c = h.idle.back();
+                h.idle.pop_back();
+                unwatch(*c);
+                destroy(c);
+            }
+        }
+
+        std::unordered_set<connection*> connecting;
+        connecting.swap(m_connecting);
+        for (connection* c : connecting)
+            destroy(c);
+
+        ++m_closing;
+        m_wheel.close([this]() { closed_one(); });
+    }
+
+    /// connections open, idle, leased or connecting
+    size_t open() const
+    {
+        size_t n = 0;
+        for (const auto& entry : m_hosts)
+            n += entry.second->open;
+        return n;
+    }
+
+    size_t idle() const
+    {
+        size_t n = 0;
+        for (const auto& entry : m_hosts)
+            n += entry.second->idle.size();
+        return n;
+    }
+
+    /// checkouts waiting for a connection
+    size_t waiting() const
+    {
+        size_t n = 0;
+        for (const auto& entry : m_hosts)
+            n += entry.second->waiting.size();
+        return n;
+    }
+
+    /// connections established so far
+    uint64_t connects() const
+    {
+        return m_connects;
+    }
+
+    /// checkouts served with an existing connection
+    uint64_t reuses() const
+    {
+        return m_reuses;
+    }
+
+private:
+    struct host
+    {
+        connection_pool* pool;
+        endpoint addr;
+        size_t open;
+        /// most recently released last
+        std::vector<connection*> idle;
+        std::deque<checkout_callback> waiting;
+    };
+
+    /// the host of ip and port, added on first use; returns a libuv error code when ip is invalid
+    int get_host(const std::string& ip, int port, host*& result)
+    {
+        const std::pair<std::string, int> key(ip, port);
+        auto it = m_hosts.find(key);
+        if (it == m_hosts.end())
+        {
+            // parsed up front, so that a malformed ip doesn't take a connection slot
+            sockaddr_storage addr;
+            const int res = ip.find(':') == std::string::npos
+                            ? uv_ip4_addr(ip.c_str(), port, reinterpret_cast<sockaddr_in*>(&addr))
+                            : uv_ip6_addr(ip.c_str(), port, reinterpret_cast<sockaddr_in6*>(&addr));
+            if (res != 0)
+                return res;
+
+            std::unique_ptr<host> h(new host());
+            h->pool = this;
+            h->addr = endpoint(reinterpret_cast<const sockaddr*>(&addr));
+            h->open = 0;
+            it = m_hosts.emplace(key, std::move(h)).first;
+        }
+        result = it->second.get();
+        return 0;
+    }
+
+    void connect(host& h, checkout_callback callback)
+    {
+        ++h.open;
+        connection* c = new connection(m_loop, &h);
+        m_connecting.insert(c);
+        auto connected = [this, c, callback](error err)
+        {
+            // close() closed it while connecting, it's gone once its close callback ran
+            if (m_connecting.erase(c) == 0)
+            {
+                callback(error(UV_ECANCELED), lease());
+                return;
+            }
+
+            host& h = *c->owner;
+            if (! err && m_closed)
+                err = error(UV_ECANCELED);
+            if (err)
+            {
+                destroy(c);
+                callback(err, lease());
+                serve_waiting(h);
+                return;
+            }
+
+            ++m_connects;
+            c->tcp.nodelay(m_options.nodelay);
+            if (m_options.keepalive_delay)
+                c->tcp.keepalive(true, m_options.keepalive_delay);
+            callback(error(0), lease(this, c));
+        };
+
+        const int res = c->tcp.connect_status(h.addr.get(), connected);
+        if (res != 0)
+            connected(error(res));
+    }
+
+    void give_back(connection* c)
+    {
+        host& h = *c->owner;
+        // the next holder's responses aren't for the previous one's read callback
+        c->tcp.read_stop();
+        if (! h.waiting.empty())
+        {
+            checkout_callback callback = std::move(h.waiting.front());
+            h.waiting.pop_front();
+            ++m_reuses;
+            callback(error(0), lease(this, c));
+            return;
+        }
+
+        if (m_closed || h.idle.size() >= m_options.max_idle_per_host)
+        {
+            destroy(c);
+            return;
+        }
+        watch(*c);
+        h.idle.push_back(c);
+    }
+
+    void discard(connection* c)
+    {
+        host& h = *c->owner;
+        destroy(c);
+        serve_waiting(h);
+    }
+
+    /// a connection of h was closed, which makes room for a waiting checkout
+    void serve_waiting(host& h)
+    {
+        if (m_closed || h.waiting.empty() || h.open >= m_options.max_per_host)
+            return;
+        checkout_callback callback = std::move(h.waiting.front());
+        h.waiting.pop_front();
+        connect(h, std::move(callback));
+    }
+
+    void evict(connection* c)
+    {
+        host& h = *c->owner;
+        h.idle.erase(std::find(h.idle.begin(), h.idle.end(), c));
+        unwatch(*c);
+        destroy(c);
+        serve_waiting(h);
+    }
+
+    void watch(connection& c)
+    {
+        connection* conn = &c;
+        // the peer has nothing to say on an idle connection: EOF, an error or data evict it
+        c.tcp.read_start([this, conn](const char*, ssize_t) { evict(conn); });
+        c.idle.data = conn;
+        c.idle.run = [](timer_wheel::node* n)
+        {
+            connection* conn = static_cast<connection*>(n->data);
+            conn->owner->pool->evict(conn);
+        };
+        m_wheel.arm(c.idle, m_options.idle_timeout);
+    }
+
+    void unwatch(connection& c)
+    {
+        c.tcp.read_stop();
+        m_wheel.cancel(c.idle);
+    }
+
+    bool healthy(connection& c)
+    {
+#ifndef _WIN32
+        uv_os_fd_t fd;
+        if (uv_fileno(c.tcp.get<uv_handle_t>(), &fd) != 0)
+            return false;
+        // closed by the peer, or data nobody asked for
+        char byte;
+        if (::recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return false;
+#endif
+        return ! m_options.health_check || m_options.health_check(c.tcp);
+    }
+
+    void destroy(connection* c)
+    {
+        --c->owner->open;
+        ++m_closing;
+        c->tcp.close([this, c]()
+        {
+            delete c;
+            closed_one();
+        });
+    }
+
+    /// the close callback waits for the leased connections as well
+    void closed_one()
+    {
+        if (--m_closing == 0 && m_closed && m_on_closed && open() == 0)
+        {
+            Callback callback = std::move(m_on_closed);
+            m_on_closed = nullptr;
+            callback();
+        }
+    }
+
+    loop& m_loop;
+    options m_options;
+    std::map<std::pair<std::string, int>, std::unique_ptr<host>> m_hosts;
+    timer_wheel m_wheel;
+    /// handles being closed, the wheel's and the connections'
+    size_t m_closing;
+    std::unordered_set<connection*> m_connecting;
+    bool m_closed;
+    Callback m_on_closed;
+    uint64_t m_connects;
+    uint64_t m_reuses;
+};
+}
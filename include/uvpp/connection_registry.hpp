@@ -0,0 +1,200 @@
+#pragma once
+
+#include <assert.h>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace uvpp {
+/**
+ * Objects, typically the connections of a loop, stored in place in an array of slots and named by
+ * compact integer ids: insert, lookup and erase are O(1) without hashing or comparing keys.
+ *
+ * An id is the index of its slot and the generation of the slot, bumped on every erase, so that the
+ * id of an erased object is never mistaken for the object reusing its slot: get returns null. Freed
+ * slots are reused most recently freed first, while they're still in cache. Slots are allocated in
+ * chunks which never move, an object keeps its address for as long as it's registered, as handles
+ * whose callbacks capture it need.
+ *
+ * Only used from the loop's thread. Ids are plain integers which other threads can hold and post
+ * back to the loop, with a loop_executor for instance, where a stale one is simply not found.
+ */
+template<typename T, unsigned chunk_bits = 10>
+class connection_registry
+{
+public:
+    typedef uint64_t id_type;
+
+    /// never handed out
+    static const id_type invalid_id = 0;
+
+    connection_registry():
+        m_free(none)
+        , m_used(0)
+        , m_size(0)
+    {
+    }
+
+    ~connection_registry()
+    {
+        clear();
+    }
+
+    connection_registry(const connection_registry&) = delete;
+    connection_registry& operator=(const connection_registry&) = delete;
+
+    /// constructs a T from args in a free slot
+    template<typename... A>
+    id_type emplace(A&&... args)
+    {
+        const bool fresh = m_free == none;
+        const uint32_t index = fresh ? m_used : m_free;
+        if (fresh && m_used == m_chunks.size() * chunk_size)
+            m_chunks.push_back(std::unique_ptr<slot[]>(new slot[chunk_size]));
+
+        // the slot is taken once constructing succeeded
+        slot& s = at(index);
+        new (&s.storage) T(std::forward<A>(args)...);
+        if (fresh)
+            ++m_used;
+        else
+            m_free = s.next_free;
+        s.live = true;
+        ++m_size;
+        return make_id(index, s.generation);
+    }
+
+    /// the object named by id, null if it was erased
+    T* get(id_type id)
+    {
+        slot* s = find(id);
+        return s ? object(*s) : nullptr;
+    }
+
+    const T* get(id_type id) const
+    {
+        return const_cast<connection_registry*>(this)->get(id);
+    }
+
+    bool contains(id_type id) const
+    {
+        return get(id) != nullptr;
+    }
+
+    /// destroys the object named by id, false if it was erased already
+    bool erase(id_type id)
+    {
+        slot* s = find(id);
+        if (! s)
+            return false;
+        release(*s, static_cast<uint32_t>(id));
+        return true;
+    }
+
+    /// calls f(id, object) for every object, which mustn't insert or erase meanwhile
+    template<typename F>
+    void for_each(F f)
+    {
+        for (uint32_t i = 0; i < m_used; ++i)
+        {
+            slot& s = at(i);
+            if (s.live)
+                f(make_id(i, s.generation), *object(s));
+        }
+    }
+
+    void clear()
+    {
+        for (uint32_t i = 0; i < m_used; ++i)
+        {
+            slot& s = at(i);
+            if (s.live)
+                release(s, i);
+        }
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    /// slots allocated, live or free
+    size_t capacity() const
+    {
+        return m_chunks.size() * chunk_size;
+    }
+
+private:
+    static const uint32_t chunk_size = 1u << chunk_bits;
+    static const uint32_t chunk_mask = chunk_size - 1;
+    static const uint32_t none = ~0u;
+
+    struct slot
+    {
+        slot():
+            generation(1)
+            , next_free(none)
+            , live(false)
+        {
+        }
+
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        uint32_t generation;
+        uint32_t next_free;
+        bool live;
+    };
+
+    static id_type make_id(uint32_t index, uint32_t generation)
+    {
+        return (static_cast<id_type>(generation) << 32) | index;
+    }
+
+    static T* object(slot& s)
+    {
+        return reinterpret_cast<T*>(&s.storage);
+    }
+
+    slot& at(uint32_t index)
+    {
+        return m_chunks[index >> chunk_bits][index & chunk_mask];
+    }
+
+    slot* find(id_type id)
+    {
+        const uint32_t index = static_cast<uint32_t>(id);
+        if (index >= m_used)
+            return nullptr;
+        slot& s = at(index);
+        if (! s.live || s.generation != static_cast<uint32_t>(id >> 32))
+            return nullptr;
+        return &s;
+    }
+
+    void release(slot& s, uint32_t index)
+    {
+        // the destructor may look the object up, by then it's gone
+        s.live = false;
+        if (++s.generation == 0)
+            s.generation = 1;
+        --m_size;
+        object(s)->~T();
+        s.next_free = m_free;
+        m_free = index;
+    }
+
+    std::vector<std::unique_ptr<slot[]>> m_chunks;
+    /// head of the list of free slots
+    uint32_t m_free;
+    /// slots ever used, the next fresh one
+    uint32_t m_used;
+    size_t m_size;
+};
+}
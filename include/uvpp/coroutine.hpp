@@ -0,0 +1,750 @@
+#pragma once
+
+/**
+ * co_await-able versions of the callback API, available when compiling as C++20.
+ *
+ * Coroutines are tasks: lazy, started by co_await from another task or by spawn, and resumed from
+ * the libuv callbacks so they run on the thread of the loop of the handles they await. Awaiting
+ * keeps the libuv request in the coroutine frame or goes through the pooled requests of the
+ * loop, so a task allocates nothing beyond its frame, which can come from a frame_allocator.
+ *
+ *   co::task<> echo(Tcp& conn)
+ *   {
+ *       char buf[4096];
+ *       ssize_t len;
+ *       while ((len = co_await co::read(conn, buf, sizeof(buf))) > 0)
+ *           co_await co::write(conn, buf, len);
+ *       conn.close();
+ *   }
+ */
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#include "stream.hpp"
+#include "tcp.hpp"
+#include "timer.hpp"
+#include "file.hpp"
+#include "resolver.hpp"
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace uvpp {
+namespace co {
+/**
+ * Source of coroutine frames, see set_frame_allocator
+ */
+class frame_allocator
+{
+public:
+    virtual ~frame_allocator()
+    {
+    }
+
+    virtual void* allocate(size_t size) = 0;
+    virtual void deallocate(void* p, size_t size) = 0;
+};
+
+/**
+ * Keeps freed frames on free lists by size, rounded up to 64 bytes, for the next coroutines of
+ * the same size. Like the other pools it belongs to one thread.
+ */
+class frame_pool : public frame_allocator
+{
+public:
+    static const size_t granularity = 64;
+
+    explicit frame_pool(size_t max_free_per_size = 1024):
+        m_max_free(max_free_per_size)
+    {
+    }
+
+    ~frame_pool()
+    {
+        for (std::vector<void*>& frames : m_free)
+        {
+            for (void* p : frames)
+                ::operator delete(p);
+        }
+    }
+
+    frame_pool(const frame_pool&) = delete;
+    frame_pool& operator=(const frame_pool&) = delete;
+
+    void* allocate(size_t size) override
+    {
+        const size_t c = size_class(size);
+        if (c < m_free.size() && ! m_free[c].empty())
+        {
+            void* p = m_free[c].back();
+            m_free[c].pop_back();
+            return p;
+        }
+        return ::operator new((c + 1) * granularity);
+    }
+
+    void deallocate(void* p, size_t size) override
+    {
+        const size_t c = size_class(size);
+        if (c >= m_free.size())
+            m_free.resize(c + 1);
+        if (m_free[c].size() < m_max_free)
+            m_free[c].push_back(p);
+        else
+            ::operator delete(p);
+    }
+
+private:
+    static size_t size_class(size_t size)
+    {
+        return (size + granularity - 1) / granularity - 1;
+    }
+
+    size_t m_max_free;
+    std::vector<std::vector<void*>> m_free;
+};
+
+namespace internal {
+inline frame_allocator*& current_frame_allocator()
+{
+    static thread_local frame_allocator* allocator = nullptr;
+    return allocator;
+}
+
+/**
+ * Frames start with the allocator they came from, so that they go back to it even if the
+ * current one changed meanwhile. 16 bytes to keep the frame aligned as operator new would.
+ */
+struct frame_header
+{
+    frame_allocator* allocator;
+    size_t reserved;
+};
+
+/// base of the promises, routing their frames to the current frame_allocator
+struct frame_allocated
+{
+    static void* operator new(size_t size)
+    {
+        frame_allocator* allocator = current_frame_allocator();
+        const size_t total = size + sizeof(frame_header);
+        frame_header* h = static_cast<frame_header*>(allocator ? allocator->allocate(total) : ::operator new(total));
+        h->allocator = allocator;
+        return h + 1;
+    }
+
+    static void operator delete(void* p, size_t size)
+    {
+        frame_header* h = static_cast<frame_header*>(p) - 1;
+        if (h->allocator)
+            h->allocator->deallocate(h, size + sizeof(frame_header));
+        else
+            ::operator delete(h);
+    }
+};
+}
+
+/**
+ * Frames of the coroutines created on this thread from now on come from allocator, or the heap
+ * when nullptr. Returns the previous one.
+ */
+inline frame_allocator* set_frame_allocator(frame_allocator* allocator)
+{
+    frame_allocator* previous = internal::current_frame_allocator();
+    internal::current_frame_allocator() = allocator;
+    return previous;
+}
+
+template<typename T = void>
+class task;
+
+namespace internal {
+struct promise_base : frame_allocated
+{
+    /// resumes whoever awaited the task once it finishes
+    struct final_awaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template<typename promise_t>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_t> h) noexcept
+        {
+            std::coroutine_handle<> continuation = h.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    final_awaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception()
+    {
+        exception = std::current_exception();
+    }
+
+    void rethrow()
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+};
+
+template<typename T>
+struct task_promise : promise_base
+{
+    task<T> get_return_object();
+
+    void return_value(T v)
+    {
+        value.emplace(std::move(v));
+    }
+
+    T result()
+    {
+        rethrow();
+        return std::move(*value);
+    }
+
+    std::optional<T> value;
+};
+
+template<>
+struct task_promise<void> : promise_base
+{
+    task<void> get_return_object();
+
+    void return_void()
+    {
+    }
+
+    void result()
+    {
+        rethrow();
+    }
+};
+}
+
+/**
+ * Lazy coroutine returning T. It starts when awaited, and the awaiter resumes when it finishes,
+ * getting its result or exception.
+ */
+template<typename T>
+class [[nodiscard]] task
+{
+public:
+    typedef internal::task_promise<T> promise_type;
+
+    task(task&& other) noexcept:
+        m_handle(std::exchange(other.m_handle, nullptr))
+    {
+    }
+
+    task& operator=(task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~task()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    bool done() const
+    {
+        return ! m_handle || m_handle.done();
+    }
+
+    bool await_ready() const noexcept
+    {
+        return done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+
+    T await_resume()
+    {
+        return m_handle.promise().result();
+    }
+
+private:
+    friend promise_type;
+
+    explicit task(std::coroutine_handle<promise_type> h):
+        m_handle(h)
+    {
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace internal {
+template<typename T>
+inline task<T> task_promise<T>::get_return_object()
+{
+    return task<T>(std::coroutine_handle<task_promise>::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object()
+{
+    return task<void>(std::coroutine_handle<task_promise>::from_promise(*this));
+}
+
+/// eager coroutine destroying itself when done, runs spawned tasks
+struct detached
+{
+    struct promise_type : frame_allocated
+    {
+        detached get_return_object() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void() noexcept
+        {
+        }
+
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+inline detached run_detached(task<void> t)
+{
+    co_await t;
+}
+}
+
+/**
+ * Starts t, which runs until its first suspension before spawn returns and is destroyed once it
+ * finishes. An exception escaping it terminates.
+ */
+inline void spawn(task<void> t)
+{
+    internal::run_detached(std::move(t));
+}
+
+/**
+ * Awaiter completing with an error, the base of those wrapping a callback taking an error
+ */
+class error_awaiter
+{
+public:
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    error await_resume() const noexcept
+    {
+        return m_error;
+    }
+
+protected:
+    error_awaiter():
+        m_error(0)
+    {
+    }
+
+    /// callback for the wrapped call
+    CallbackWithResult completion()
+    {
+        return [this](error err)
+        {
+            m_error = err;
+            m_handle.resume();
+        };
+    }
+
+    /// to be returned from await_suspend, resuming right away when starting failed
+    bool started(bool ok, int failure)
+    {
+        if (! ok)
+            m_error = error(failure);
+        return ok;
+    }
+
+    std::coroutine_handle<> m_handle;
+    error m_error;
+};
+
+/// co_await connect(tcp, ip, port) connects to an IPv4 address
+class connect_awaiter : public error_awaiter
+{
+public:
+    connect_awaiter(Tcp& tcp, std::string ip, int port):
+        m_tcp(tcp)
+        , m_ip(std::move(ip))
+        , m_port(port)
+    {
+    }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        m_handle = h;
+        return started(m_tcp.connect(m_ip, m_port, completion()), UV_EINVAL);
+    }
+
+private:
+    Tcp& m_tcp;
+    std::string m_ip;
+    int m_port;
+};
+
+inline connect_awaiter connect(Tcp& tcp, std::string ip, int port)
+{
+    return connect_awaiter(tcp, std::move(ip), port);
+}
+
+/// co_await write(stream, buf, len) writes len bytes from buf, which must stay valid meanwhile
+template<typename HANDLE_T>
+class write_awaiter : public error_awaiter
+{
+public:
+    write_awaiter(stream<HANDLE_T>& s, const char* buf, size_t len):
+        m_stream(s)
+        , m_buf(buf)
+        , m_len(len)
+    {
+    }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        m_handle = h;
+        return started(m_stream.write(m_buf, static_cast<int>(m_len), completion()), UV_EPIPE);
+    }
+
+private:
+    stream<HANDLE_T>& m_stream;
+    const char* m_buf;
+    size_t m_len;
+};
+
+template<typename HANDLE_T>
+write_awaiter<HANDLE_T> write(stream<HANDLE_T>& s, const char* buf, size_t len)
+{
+    return write_awaiter<HANDLE_T>(s, buf, len);
+}
+
+template<typename HANDLE_T>
+write_awaiter<HANDLE_T> write(stream<HANDLE_T>& s, const std::string& buf)
+{
+    return write_awaiter<HANDLE_T>(s, buf.data(), buf.size());
+}
+
+/**
+ * co_await read(stream, buf, len) reads into buf as soon as there is data, returning the number
+ * of bytes read or a negative error, UV_EOF at the end
+ */
+template<typename HANDLE_T>
+class read_awaiter
+{
+public:
+    read_awaiter(stream<HANDLE_T>& s, char* buf, size_t len):
+        m_stream(s)
+        , m_buf(buf)
+        , m_len(len)
+        , m_result(0)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        m_handle = h;
+        read_awaiter* self = this;
+        // the callbacks only touch self after resuming, which may start the next read and replace them
+        const bool ok = m_stream.read_start_into([self](size_t)
+        {
+            return uv_buf_t { self->m_buf, self->m_len };
+        },
+        [self](const char*, ssize_t len)
+        {
+            self->completed(len);
+        });
+        if (! ok)
+            m_result = UV_EINVAL;
+        return ok;
+    }
+
+    ssize_t await_resume() const noexcept
+    {
+        return m_result;
+    }
+
+private:
+    void completed(ssize_t len)
+    {
+        if (len == 0)
+            return;
+        m_stream.read_stop();
+        m_result = len;
+        m_handle.resume();
+    }
+
+    stream<HANDLE_T>& m_stream;
+    char* m_buf;
+    size_t m_len;
+    ssize_t m_result;
+    std::coroutine_handle<> m_handle;
+};
+
+template<typename HANDLE_T>
+read_awaiter<HANDLE_T> read(stream<HANDLE_T>& s, char* buf, size_t len)
+{
+    return read_awaiter<HANDLE_T>(s, buf, len);
+}
+
+/// co_await sleep(timer, timeout) resumes after timeout using timer
+class sleep_awaiter : public error_awaiter
+{
+public:
+    sleep_awaiter(Timer& timer, std::chrono::duration<uint64_t, std::milli> timeout):
+        m_timer(timer)
+        , m_timeout(timeout)
+    {
+    }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        m_handle = h;
+        m_error = m_timer.start([h]() { h.resume(); }, m_timeout);
+        return ! m_error;
+    }
+
+private:
+    Timer& m_timer;
+    std::chrono::duration<uint64_t, std::milli> m_timeout;
+};
+
+inline sleep_awaiter sleep(Timer& timer, std::chrono::duration<uint64_t, std::milli> timeout)
+{
+    return sleep_awaiter(timer, timeout);
+}
+
+/// co_await open(file, flags, mode)
+class open_awaiter : public error_awaiter
+{
+public:
+    open_awaiter(File& file, int flags, int mode):
+        m_file(file)
+        , m_flags(flags)
+        , m_mode(mode)
+    {
+    }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        m_handle = h;
+        m_error = m_file.open(m_flags, m_mode, completion());
+        return ! m_error;
+    }
+
+private:
+    File& m_file;
+    int m_flags;
+    int m_mode;
+};
+
+inline open_awaiter open(File& file, int flags, int mode)
+{
+    return open_awaiter(file, flags, mode);
+}
+
+/**
+ * co_await read(file, buf, len, offset) returns the number of bytes read into buf, 0 at the end
+ * of the file, or a negative error
+ */
+class file_read_awaiter
+{
+public:
+    file_read_awaiter(File& file, char* buf, size_t len, int64_t offset):
+        m_file(file)
+        , m_buf(buf)
+        , m_len(len)
+        , m_offset(offset)
+        , m_result(0)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        m_handle = h;
+        file_read_awaiter* self = this;
+        const error err = m_file.read_into(m_buf, m_len, m_offset, [self](ssize_t len)
+        {
+            self->m_result = len;
+            self->m_handle.resume();
+        });
+        if (err)
+            m_result = UV_EIO;
+        return ! err;
+    }
+
+    ssize_t await_resume() const noexcept
+    {
+        return m_result;
+    }
+
+private:
+    File& m_file;
+    char* m_buf;
+    size_t m_len;
+    int64_t m_offset;
+    ssize_t m_result;
+    std::coroutine_handle<> m_handle;
+};
+
+inline file_read_awaiter read(File& file, char* buf, size_t len, int64_t offset)
+{
+    return file_read_awaiter(file, buf, len, offset);
+}
+
+/// co_await write(file, buf, len, offset)
+class file_write_awaiter : public error_awaiter
+{
+public:
+    file_write_awaiter(File& file, const char* buf, size_t len, int offset):
+        m_file(file)
+        , m_buf(buf)
+        , m_len(len)
+        , m_offset(offset)
+    {
+    }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        m_handle = h;
+        m_error = m_file.write(m_buf, static_cast<int>(m_len), m_offset, completion());
+        return ! m_error;
+    }
+
+private:
+    File& m_file;
+    const char* m_buf;
+    size_t m_len;
+    int m_offset;
+};
+
+inline file_write_awaiter write(File& file, const char* buf, size_t len, int offset)
+{
+    return file_write_awaiter(file, buf, len, offset);
+}
+
+struct resolve_result
+{
+    resolve_result():
+        err(0)
+        , ip4(false)
+    {
+    }
+
+    error err;
+    bool ip4;
+    std::string addr;
+};
+
+/// co_await resolve(resolver, host) returns the first address of host
+class resolve_awaiter
+{
+public:
+    resolve_awaiter(Resolver& resolver, std::string host):
+        m_resolver(resolver)
+        , m_host(std::move(host))
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        m_handle = h;
+        resolve_awaiter* self = this;
+        const bool ok = m_resolver.resolve(m_host, [self](const error& err, bool ip4, const std::string& addr)
+        {
+            self->m_result.err = err;
+            self->m_result.ip4 = ip4;
+            self->m_result.addr = addr;
+            self->m_handle.resume();
+        });
+        if (! ok)
+            m_result.err = error(UV_EINVAL);
+        return ok;
+    }
+
+    resolve_result await_resume()
+    {
+        return std::move(m_result);
+    }
+
+private:
+    Resolver& m_resolver;
+    std::string m_host;
+    resolve_result m_result;
+    std::coroutine_handle<> m_handle;
+};
+
+inline resolve_awaiter resolve(Resolver& resolver, std::string host)
+{
+    return resolve_awaiter(resolver, std::move(host));
+}
+}
+}
+#endif
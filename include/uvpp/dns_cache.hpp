@@ -0,0 +1,328 @@
+#pragma once
+
+#include "error.hpp"
+#include "loop.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace uvpp {
+typedef std::vector<sockaddr_storage> address_list;
+
+/// addr with its port set, the addresses resolved by dns_cache have port 0
+inline sockaddr_storage with_port(const sockaddr_storage& addr, int port)
+{
+    sockaddr_storage result = addr;
+    if (result.ss_family == AF_INET6)
+        reinterpret_cast<sockaddr_in6*>(&result)->sin6_port = htons(static_cast<uint16_t>(port));
+    else
+        reinterpret_cast<sockaddr_in*>(&result)->sin_port = htons(static_cast<uint16_t>(port));
+    return result;
+}
+
+namespace internal {
+/**
+ * A uv_getaddrinfo_t carrying the completion of its own lookup
+ */
+struct getaddrinfo_request
+{
+    getaddrinfo_request()
+    {
+        req.data = this;
+    }
+
+    uv_getaddrinfo_t req;
+    std::function<void(error, address_list)> done;
+};
+}
+
+/**
+ * Cache of host name lookups of a loop, in front of a pluggable resolver which defaults to
+ * uv_getaddrinfo on the threadpool.
+ *
+ * Results are kept for positive_ttl, failures for negative_ttl, a lookup of an expired name goes
+ * to the resolver again, and past max_entries the least recently used results make room. Lookups
+ * of a name already being resolved join that lookup instead of starting another one, so a burst
+ * of connects to the same host costs one resolution.
+ *
+ * Callbacks get every address resolved, in the resolver's order, as sockaddr_storage with port 0,
+ * see with_port and Tcp::connect(const sockaddr*, ...). The list is only valid during the call.
+ *
+ * Only used from the loop's thread. The loop has to run until the lookups in flight complete
+ * before the cache is destroyed, see pending().
+ */
+class dns_cache
+{
+public:
+    typedef std::function<void(error err, const address_list& addresses)> resolve_callback;
+    typedef std::function<void(error err, address_list addresses)> resolved_callback;
+    /// resolves host and calls done, right away or later on the loop's thread
+    typedef std::function<void(const std::string& host, resolved_callback done)> resolver_function;
+
+    struct options
+    {
+        options():
+            positive_ttl(std::chrono::seconds(60))
+            , negative_ttl(std::chrono::seconds(5))
+            , max_entries(10000)
+        {
+        }
+
+        std::chrono::milliseconds positive_ttl;
+        std::chrono::milliseconds negative_ttl;
+        /**
+         * past it the least recently used results are dropped, expired or not, but never the one
+         * just resolved: lookups in flight can take the cache over it
+         */
+        size_t max_entries;
+    };
+
+    /// resolver_function looking host up with uv_getaddrinfo for stream sockets of family
+    static resolver_function getaddrinfo_resolver(loop& l, int family = AF_UNSPEC)
+    {
+        uv_loop_t* lp = l.get();
+        return [lp, family](const std::string& host, resolved_callback done)
+        {
+            slab& requests = internal::get_slab(lp);
+            internal::getaddrinfo_request* req = requests.create<internal::getaddrinfo_request>();
+            req->done = std::move(done);
+            addrinfo hints = addrinfo();
+            hints.ai_family = family;
+            hints.ai_socktype = SOCK_STREAM;
+            const int res = uv_getaddrinfo(lp, &req->req, &dns_cache::on_getaddrinfo, host.c_str(), nullptr, &hints);
+            if (res != 0)
+            {
+                resolved_callback callback(std::move(req->done));
+                requests.destroy(req);
+                callback(error(res), address_list());
+            }
+        };
+    }
+
+    explicit dns_cache(loop& l, const options& opts = options()):
+        m_loop(l.get())
+        , m_options(opts)
+        , m_resolve(getaddrinfo_resolver(l))
+        , m_hits(0)
+        , m_negative_hits(0)
+        , m_misses(0)
+        , m_coalesced(0)
+        , m_pending(0)
+    {
+    }
+
+    dns_cache(loop& l, resolver_function resolver, const options& opts = options()):
+        m_loop(l.get())
+        , m_options(opts)
+        , m_resolve(std::move(resolver))
+        , m_hits(0)
+        , m_negative_hits(0)
+        , m_misses(0)
+        , m_coalesced(0)
+        , m_pending(0)
+    {
+        assert(m_resolve);
+    }
+
+    dns_cache(const dns_cache&) = delete;
+    dns_cache& operator=(const dns_cache&) = delete;
+
+    /// callback is called right away on a hit, with the error of the lookup on a negative hit
+    void resolve(const std::string& host, resolve_callback callback)
+    {
+        assert(callback);
+        entry& e = m_entries[host];
+        if (e.resolving)
+        {
+            ++m_coalesced;
+            e.waiting.push_back(std::move(callback));
+            return;
+        }
+        if (e.addresses && uv_now(m_loop) < e.expires)
+        {
+            if (e.status)
+                ++m_negative_hits;
+            else
+                ++m_hits;
+            m_lru.splice(m_lru.end(), m_lru, e.lru);
+            // the callback may clear the cache
+            std::shared_ptr<const address_list> addresses = e.addresses;
+            callback(error(e.status), *addresses);
+            return;
+        }
+
+        ++m_misses;
+        ++m_pending;
+        // only results can be evicted, not lookups in flight
+        if (e.listed)
+        {
+            m_lru.erase(e.lru);
+            e.listed = false;
+        }
+        e.resolving = true;
+        e.waiting.push_back(std::move(callback));
+        m_resolve(host, [this, host](error err, address_list addresses)
+        {
+            completed(host, err, std::move(addresses));
+        });
+    }
+
+    /// drops the results cached, the lookups in flight still complete
+    void clear()
+    {
+        for (auto it = m_entries.begin(); it != m_entries.end();)
+        {
+            if (it->second.resolving)
+                ++it;
+            else
+                it = m_entries.erase(it);
+        }
+        m_lru.clear();
+    }
+
+    /// names cached or being resolved
+    size_t size() const
+    {
+        return m_entries.size();
+    }
+
+    /// lookups in flight in the resolver
+    size_t pending() const
+    {
+        return m_pending;
+    }
+
+    uint64_t hits() const
+    {
+        return m_hits;
+    }
+
+    /// hits on a cached failure
+    uint64_t negative_hits() const
+    {
+        return m_negative_hits;
+    }
+
+    /// lookups which went to the resolver
+    uint64_t misses() const
+    {
+        return m_misses;
+    }
+
+    /// lookups which joined one in flight
+    uint64_t coalesced() const
+    {
+        return m_coalesced;
+    }
+
+    /// share of the lookups which didn't go to the resolver, 0 before any
+    double hit_rate() const
+    {
+        const uint64_t served = m_hits + m_negative_hits + m_coalesced;
+        const uint64_t total = served + m_misses;
+        return total ? static_cast<double>(served) / total : 0;
+    }
+
+private:
+    struct entry
+    {
+        entry():
+            status(0)
+            , expires(0)
+            , resolving(false)
+            , listed(false)
+        {
+        }
+
+        /// null until the first lookup completes
+        std::shared_ptr<const address_list> addresses;
+        int status;
+        /// in uv_now time
+        uint64_t expires;
+        bool resolving;
+        /// in m_lru, which holds the entries with a result and no lookup in flight
+        bool listed;
+        std::list<const std::string*>::iterator lru;
+        std::vector<resolve_callback> waiting;
+    };
+
+    static void on_getaddrinfo(uv_getaddrinfo_t* r, int status, addrinfo* res)
+    {
+        internal::getaddrinfo_request* req = static_cast<internal::getaddrinfo_request*>(r->data);
+        resolved_callback callback(std::move(req->done));
+        internal::get_slab(r->loop).destroy(req);
+
+        address_list addresses;
+        for (addrinfo* ai = res; ai; ai = ai->ai_next)
+        {
+            if (ai->ai_family != AF_INET && ai->ai_family != AF_INET6)
+                continue;
+            sockaddr_storage addr = sockaddr_storage();
+            memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+            addresses.push_back(addr);
+        }
+        uv_freeaddrinfo(res);
+        if (! status && addresses.empty())
+            status = UV_EAI_NODATA;
+        callback(error(status), std::move(addresses));
+    }
+
+    void completed(const std::string& host, error err, address_list addresses)
+    {
+        --m_pending;
+        auto it = m_entries.find(host);
+        assert(it != m_entries.end());
+        entry& e = it->second;
+        e.resolving = false;
+        e.status = err.code();
+        e.addresses = std::make_shared<const address_list>(std::move(addresses));
+        const std::chrono::milliseconds ttl = e.status ? m_options.negative_ttl : m_options.positive_ttl;
+        e.expires = uv_now(m_loop) + static_cast<uint64_t>(ttl.count());
+
+        std::vector<resolve_callback> waiting;
+        waiting.swap(e.waiting);
+        std::shared_ptr<const address_list> result = e.addresses;
+        const int status = e.status;
+        // evicting before listing the fresh result keeps it, also when the lookups in flight
+        // alone fill the cache
+        evict();
+        // keys of unordered_map nodes don't move
+        e.lru = m_lru.insert(m_lru.end(), &it->first);
+        e.listed = true;
+
+        // the callbacks may resolve again, also this host, or clear the cache
+        for (resolve_callback& callback : waiting)
+            callback(error(status), *result);
+    }
+
+    /// drops the least recently used results until the cache fits max_entries
+    void evict()
+    {
+        while (m_entries.size() > m_options.max_entries && ! m_lru.empty())
+        {
+            auto it = m_entries.find(*m_lru.front());
+            m_lru.pop_front();
+            m_entries.erase(it);
+        }
+    }
+
+    uv_loop_t* m_loop;
+    options m_options;
+    resolver_function m_resolve;
+    std::unordered_map<std::string, entry> m_entries;
+    /// least recently used first
+    std::list<const std::string*> m_lru;
+    uint64_t m_hits;
+    uint64_t m_negative_hits;
+    uint64_t m_misses;
+    uint64_t m_coalesced;
+    size_t m_pending;
+};
+}
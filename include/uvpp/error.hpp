@@ -33,6 +33,12 @@ public:
         return uv_strerror(m_error);
     }
 
+    /// the libuv error code, 0 for success
+    int code() const
+    {
+        return m_error;
+    }
+
 private:
     int m_error;
 };
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "stream.hpp"
+#include "shared_buffer.hpp"
+
+#include <memory>
+
+namespace uvpp {
+/// what fanout does with a subscriber whose write queue is over max_queued
+enum class slow_policy
+{
+    /// write anyway, the queue grows
+    queue,
+    /// leave it out of this message, it gets the next ones once it caught up
+    skip,
+    /// leave it out and hand it to the drop callback, which typically closes it
+    drop
+};
+
+struct fanout_options
+{
+    fanout_options():
+        max_queued(64 * 1024)
+        , policy(slow_policy::skip)
+    {
+    }
+
+    /// bytes waiting in a stream's write queue past which its subscriber is slow
+    size_t max_queued;
+    slow_policy policy;
+};
+
+struct fanout_result
+{
+    fanout_result():
+        queued(0)
+        , skipped(0)
+        , dropped(0)
+        , failed(0)
+    {
+    }
+
+    size_t queued;
+    size_t skipped;
+    size_t dropped;
+    /// writes libuv refused, on a closing stream for instance
+    size_t failed;
+};
+
+namespace internal {
+template<typename HANDLE_T>
+stream<HANDLE_T>& subscriber_stream(stream<HANDLE_T>& s)
+{
+    return s;
+}
+
+template<typename HANDLE_T>
+stream<HANDLE_T>& subscriber_stream(stream<HANDLE_T>* s)
+{
+    return *s;
+}
+
+template<typename T>
+auto subscriber_stream(const std::unique_ptr<T>& s) -> decltype(subscriber_stream(*s))
+{
+    return subscriber_stream(*s);
+}
+
+template<typename T>
+auto subscriber_stream(const std::shared_ptr<T>& s) -> decltype(subscriber_stream(*s))
+{
+    return subscriber_stream(*s);
+}
+}
+
+/**
+ * Queues msg on every stream of [first, last), streams or pointers to them: each write holds a
+ * reference to msg instead of a copy of it, and takes no allocation of its own beyond the loop's
+ * slab, so the bytes are freed once the last of the writes has completed. Write errors surface
+ * through the streams' reads, as for any write.
+ *
+ * A subscriber whose write queue holds max_queued bytes or more is slow, it's handled according
+ * to the policy. drop(*it) is called for each subscriber dropped as it's met, it may close the
+ * stream but mustn't invalidate the range.
+ */
+template<typename Iterator, typename Drop>
+fanout_result fanout(Iterator first, Iterator last, const shared_buffer& msg, const fanout_options& opts, Drop&& drop)
+{
+    fanout_result result;
+    for (Iterator it = first; it != last; ++it)
+    {
+        auto& s = internal::subscriber_stream(*it);
+        if (opts.policy != slow_policy::queue && s.write_queue_size() >= opts.max_queued)
+        {
+            if (opts.policy == slow_policy::skip)
+            {
+                ++result.skipped;
+            }
+            else
+            {
+                ++result.dropped;
+                drop(*it);
+            }
+            continue;
+        }
+        if (s.write(msg, [](error) {}))
+            ++result.queued;
+        else
+            ++result.failed;
+    }
+    return result;
+}
+
+/// fanout without a drop callback, the policy is queue or skip
+template<typename Iterator>
+fanout_result fanout(Iterator first, Iterator last, const shared_buffer& msg, const fanout_options& opts = fanout_options())
+{
+    assert(opts.policy != slow_policy::drop);
+    return fanout(first, last, msg, opts, [](decltype(*first)) {});
+}
+}
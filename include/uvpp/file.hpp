@@ -2,6 +2,7 @@
 
 #include "request.hpp"
 #include "error.hpp"
+#include "loop.hpp"
 
 #include <memory>
 #include <chrono>
@@ -63,6 +64,17 @@ struct WriteOptions
     int mode = S_IRUSR | S_IWUSR;
 };
 
+namespace internal {
+template<>
+struct handle_traits<uv_fs_t>
+{
+    typedef callback_slots<
+        uv_cid_fs_open, uv_cid_fs_read, uv_cid_fs_write, uv_cid_fs_close,
+        uv_cid_fs_unlink, uv_cid_fs_stats, uv_cid_fs_fsync, uv_cid_fs_rename,
+        uv_cid_fs_sendfile, uv_cid_fs_scandir> callbacks_type;
+};
+}
+
 class File : public request<uv_fs_t>
 {
 public:
@@ -137,12 +149,12 @@ public:
         std::string fullPath_;
     };
 
-    File(const std::string &path) : request<uv_fs_t>(), loop_(uv_default_loop()), path_(path)
+    File(const std::string &path) : request<uv_fs_t>(uv_default_loop()), loop_(uv_default_loop()), path_(path)
     {
 
     }
 
-    File(loop &l, const std::string &path) : request<uv_fs_t>(), loop_(l.get()), path_(path)
+    File(loop &l, const std::string &path) : request<uv_fs_t>(l.get()), loop_(l.get()), path_(path)
     {
 
     }
@@ -157,20 +169,20 @@ public:
             callback(err);
         };
 
-        callbacks::store(get()->data, internal::uv_cid_fs_open, openCallback);
+        slots(get()->data).store<internal::uv_cid_fs_open>(openCallback);
 
-        return error(uv_fs_open(loop_.get(), get(), path_.c_str(), flags, mode, [](uv_fs_t* req)
+        return error(uv_fs_open(loop_, get(), path_.c_str(), flags, mode, [](uv_fs_t* req)
         {
             auto result = req->result;
             uv_fs_req_cleanup(req);
 
             if (result<0)
             {
-                callbacks::invoke<decltype(openCallback)>(req->data, internal::uv_cid_fs_open, error(result), result);
+                slots(req->data).invoke<internal::uv_cid_fs_open>(error(result), result);
             }
             else
             {
-                callbacks::invoke<decltype(openCallback)>(req->data, internal::uv_cid_fs_open, error(0), result);
+                slots(req->data).invoke<internal::uv_cid_fs_open>(error(0), result);
             }
         }));
     }
@@ -198,13 +210,34 @@ public:
             }
         };
 
-        callbacks::store(get()->data, internal::uv_cid_fs_read, readCallback);
+        slots(get()->data).store<internal::uv_cid_fs_read>(readCallback);
+
+        return error(uv_fs_read(loop_, get(), file_, &buffer, 1, offset, [](uv_fs_t* req)
+        {
+            auto result = req->result;
+            uv_fs_req_cleanup(req);
+            slots(req->data).invoke<internal::uv_cid_fs_read>(result);
+        }));
+    }
+
+    /**
+     * Reads up to len bytes at offset into buf, which must stay valid until callback gets the
+     * number of bytes read: 0 at the end of the file, negative on error
+     */
+    error read_into(char* buf, size_t len, int64_t offset, std::function<void(ssize_t len)> callback)
+    {
+
+        if (!file_) return error(UV_EIO);
+
+        slots(get()->data).store<internal::uv_cid_fs_read>(callback);
+
+        uv_buf_t bufs[] = { uv_buf_t { buf, len } };
 
-        return error(uv_fs_read(loop_.get(), get(), file_, &buffer, 1, offset, [](uv_fs_t* req)
+        return error(uv_fs_read(loop_, get(), file_, bufs, 1, offset, [](uv_fs_t* req)
         {
             auto result = req->result;
             uv_fs_req_cleanup(req);
-            callbacks::invoke<decltype(readCallback)>(req->data, internal::uv_cid_fs_read, result);
+            slots(req->data).invoke<internal::uv_cid_fs_read>(result);
         }));
     }
 
@@ -213,21 +246,21 @@ public:
 
         if (!file_) return error(UV_EIO);
 
-        callbacks::store(get()->data, internal::uv_cid_fs_write, callback);
+        slots(get()->data).store<internal::uv_cid_fs_write>(callback);
 
         uv_buf_t bufs[] = { uv_buf_t { const_cast<char*>(buf), static_cast<size_t>(len) } };
 
-        return error(uv_fs_write(loop_.get(), get(), file_, bufs, 1, offset, [](uv_fs_t* req)
+        return error(uv_fs_write(loop_, get(), file_, bufs, 1, offset, [](uv_fs_t* req)
         {
             auto result = req->result;
             uv_fs_req_cleanup(req);
             if (result < 0)
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_write, error(result));
+                slots(req->data).invoke<internal::uv_cid_fs_write>(error(result));
             }
             else
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_write, error(0));
+                slots(req->data).invoke<internal::uv_cid_fs_write>(error(0));
             }
         }));
     }
@@ -237,12 +270,12 @@ public:
 
         if (!file_) return error(UV_EIO);
 
-        callbacks::store(get()->data, internal::uv_cid_fs_close, callback);
+        slots(get()->data).store<internal::uv_cid_fs_close>(callback);
 
-        return error(uv_fs_close(loop_.get(), get(), file_, [](uv_fs_t* req)
+        return error(uv_fs_close(loop_, get(), file_, [](uv_fs_t* req)
         {
             uv_fs_req_cleanup(req);
-            callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_close);
+            slots(req->data).invoke<internal::uv_cid_fs_close>();
         }));
     }
 
@@ -251,7 +284,7 @@ public:
 
         if (!file_) return error(UV_EIO);
 
-        return error(uv_fs_close(loop_.get(), get(), file_, nullptr));
+        return error(uv_fs_close(loop_, get(), file_, nullptr));
     }
 
     error unlink(CallbackWithResult callback)
@@ -259,19 +292,19 @@ public:
 
         if (!file_) return error(UV_EIO);
 
-        callbacks::store(get()->data, internal::uv_cid_fs_unlink, callback);
+        slots(get()->data).store<internal::uv_cid_fs_unlink>(callback);
 
-        return error(uv_fs_close(loop_.get(), get(), file_, [](uv_fs_t* req)
+        return error(uv_fs_close(loop_, get(), file_, [](uv_fs_t* req)
         {
             int result = req->result;
             uv_fs_req_cleanup(req);
             if (result < 0)
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_unlink, error(result));
+                slots(req->data).invoke<internal::uv_cid_fs_unlink>(error(result));
             }
             else
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_unlink, error(0));
+                slots(req->data).invoke<internal::uv_cid_fs_unlink>(error(0));
             }
         }));
     }
@@ -281,15 +314,15 @@ public:
 
         if (!file_) return error(UV_EIO);
 
-        return error(uv_fs_close(loop_.get(), get(), file_, nullptr));
+        return error(uv_fs_close(loop_, get(), file_, nullptr));
     }
 
     error stats(std::function<void(error err, Stats stats)> callback)
     {
-        callbacks::store(get()->data, internal::uv_cid_fs_stats, callback);
+        slots(get()->data).store<internal::uv_cid_fs_stats>(callback);
 
         return error(
-                   uv_fs_stat(loop_.get(), get(), path_.c_str(), [](uv_fs_t* req)
+                   uv_fs_stat(loop_, get(), path_.c_str(), [](uv_fs_t* req)
         {
             int result = req->result;
             Stats stats;
@@ -306,11 +339,11 @@ public:
 
             if (result < 0)
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_stats, error(result), stats);
+                slots(req->data).invoke<internal::uv_cid_fs_stats>(error(result), stats);
             }
             else
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_stats, error(0), stats);
+                slots(req->data).invoke<internal::uv_cid_fs_stats>(error(0), stats);
             }
 
         })
@@ -319,7 +352,7 @@ public:
 
     Stats stats()
     {
-        int err = uv_fs_stat(loop_.get(), get(), path_.c_str(), nullptr);
+        int err = uv_fs_stat(loop_, get(), path_.c_str(), nullptr);
 
         if (err>=0)
         {
@@ -341,10 +374,10 @@ public:
 
         if (!file_) return error(UV_EIO);
 
-        callbacks::store(get()->data, internal::uv_cid_fs_fsync, callback);
+        slots(get()->data).store<internal::uv_cid_fs_fsync>(callback);
 
         return error(
-                   uv_fs_fsync(loop_.get(), get(), file_, [](uv_fs_t* req)
+                   uv_fs_fsync(loop_, get(), file_, [](uv_fs_t* req)
         {
             int result = req->result;
 
@@ -352,11 +385,11 @@ public:
 
             if (result < 0)
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_fsync, error(result));
+                slots(req->data).invoke<internal::uv_cid_fs_fsync>(error(result));
             }
             else
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_fsync, error(0));
+                slots(req->data).invoke<internal::uv_cid_fs_fsync>(error(0));
             }
         })
                );
@@ -365,10 +398,10 @@ public:
     error rename(const std::string &newName, CallbackWithResult callback)
     {
 
-        callbacks::store(get()->data, internal::uv_cid_fs_rename, callback);
+        slots(get()->data).store<internal::uv_cid_fs_rename>(callback);
 
         return error(
-                   uv_fs_rename(loop_.get(), get(), path_.c_str(), newName.c_str(), [](uv_fs_t* req)
+                   uv_fs_rename(loop_, get(), path_.c_str(), newName.c_str(), [](uv_fs_t* req)
         {
             int result = req->result;
 
@@ -376,11 +409,11 @@ public:
 
             if (result < 0)
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_rename, error(result));
+                slots(req->data).invoke<internal::uv_cid_fs_rename>(error(result));
             }
             else
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_rename, error(0));
+                slots(req->data).invoke<internal::uv_cid_fs_rename>(error(0));
             }
         })
                );
@@ -392,10 +425,10 @@ public:
         if (!file_) return error(UV_EIO);
         if (!out.file_) return error(UV_EIO);
 
-        callbacks::store(get()->data, internal::uv_cid_fs_sendfile, callback);
+        slots(get()->data).store<internal::uv_cid_fs_sendfile>(callback);
 
         return error(
-                   uv_fs_sendfile(loop_.get(), get(), file_, out.file_, in_offset, length, [](uv_fs_t* req)
+                   uv_fs_sendfile(loop_, get(), file_, out.file_, in_offset, length, [](uv_fs_t* req)
         {
             int result = req->result;
 
@@ -403,11 +436,11 @@ public:
 
             if (result < 0)
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_sendfile, error(result));
+                slots(req->data).invoke<internal::uv_cid_fs_sendfile>(error(result));
             }
             else
             {
-                callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_fs_sendfile, error(0));
+                slots(req->data).invoke<internal::uv_cid_fs_sendfile>(error(0));
             }
         })
                );
@@ -440,19 +473,19 @@ public:
             }
         };
 
-        callbacks::store(get()->data, internal::uv_cid_fs_scandir, scanDirCallback);
+        slots(get()->data).store<internal::uv_cid_fs_scandir>(scanDirCallback);
 
         return error(
-                   uv_fs_scandir(loop_.get(), get(), path_.c_str(), 0, [](uv_fs_t* req)
+                   uv_fs_scandir(loop_, get(), path_.c_str(), 0, [](uv_fs_t* req)
         {
-            callbacks::invoke<decltype(scanDirCallback)>(req->data, internal::uv_cid_fs_scandir, req->result);
+            slots(req->data).invoke<internal::uv_cid_fs_scandir>(req->result);
         })
                );
     }
 
     std::list<Entry> scandir()
     {
-        int err = uv_fs_scandir(loop_.get(), get(), path_.c_str(), 0, nullptr);
+        int err = uv_fs_scandir(loop_, get(), path_.c_str(), 0, nullptr);
         if (err >= 0)
         {
             std::list<Entry> files;
@@ -474,8 +507,8 @@ public:
 
 
 private:
+    uv_loop_t* loop_;
     const std::string path_;
-    loop loop_;
     uv_file file_=0;
 };
 
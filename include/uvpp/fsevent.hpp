@@ -13,6 +13,14 @@ inline bool fileExists(const char *path)
     return (stat (path, &buffer) == 0);
 }
 
+namespace internal {
+template<>
+struct handle_traits<uv_fs_event_t>
+{
+    typedef callback_slots<uv_cid_close, uv_cid_fs_event> callbacks_type;
+};
+}
+
 class FsEvent : public handle<uv_fs_event_t>
 {
 public:
@@ -26,13 +34,13 @@ public:
     };
 
     FsEvent():
-        handle<uv_fs_event_t>()
+        handle<uv_fs_event_t>(uv_default_loop())
     {
         uv_fs_event_init(uv_default_loop(), get());
     }
 
     FsEvent(loop& l):
-        handle<uv_fs_event_t>()
+        handle<uv_fs_event_t>(l.get())
     {
         uv_fs_event_init(l.get(), get());
     }
@@ -74,13 +82,13 @@ public:
             }
         };
 
-        callbacks::store(get()->data, internal::uv_cid_fs_event, fsEventCallback);
+        slots(get()->data).store<internal::uv_cid_fs_event>(fsEventCallback);
 
         started_ = true;
         return error(uv_fs_event_start(get(),
                                        [](uv_fs_event_t* handle, const char* filename, int events, int status)
         {
-            callbacks::invoke<decltype(fsEventCallback)>(handle->data, internal::uv_cid_fs_event, filename, events,status);
+            slots(handle->data).invoke<internal::uv_cid_fs_event>(filename, events,status);
         }, path.c_str(), flags
                                       ));
     }
@@ -6,17 +6,25 @@
 
 namespace uvpp {
 
+namespace internal {
+template<>
+struct handle_traits<uv_fs_poll_t>
+{
+    typedef callback_slots<uv_cid_close, uv_cid_fs_poll> callbacks_type;
+};
+}
+
 class FsPoll : public handle<uv_fs_poll_t>
 {
 public:
     FsPoll():
-        handle<uv_fs_poll_t>()
+        handle<uv_fs_poll_t>(uv_default_loop())
     {
         uv_fs_poll_init(uv_default_loop(), get());
     }
 
     FsPoll(loop& l):
-        handle<uv_fs_poll_t>()
+        handle<uv_fs_poll_t>(l.get())
     {
         uv_fs_poll_init(l.get(), get());
     }
@@ -24,19 +32,19 @@ public:
     error start(const std::string &path, unsigned int interval, std::function<void(error err,int status,Stats prev,Stats current)> callback)
     {
 
-        callbacks::store(get()->data, internal::uv_cid_fs_poll, callback);
+        slots(get()->data).store<internal::uv_cid_fs_poll>(callback);
 
         return error(uv_fs_poll_start(get(),
                                       [](uv_fs_poll_t* handle,  int status, const uv_stat_t* prev, const uv_stat_t* curr)
         {
             Stats back,current;
             if (status<0)
-                callbacks::invoke<decltype(callback)>(handle->data, internal::uv_cid_fs_poll, error(status), status, back, current);
+                slots(handle->data).invoke<internal::uv_cid_fs_poll>(error(status), status, back, current);
             else
             {
                 back = statsFromUV(prev);
                 current = statsFromUV(curr);
-                callbacks::invoke<decltype(callback)>(handle->data, internal::uv_cid_fs_poll, error(0), status, back, current);
+                slots(handle->data).invoke<internal::uv_cid_fs_poll>(error(0), status, back, current);
             }
         }, path.c_str(), interval
                                      ));
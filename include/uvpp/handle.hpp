@@ -2,89 +2,170 @@
 
 #include "callback.hpp"
 #include "error.hpp"
+#include "loop.hpp"
 
 namespace uvpp {
-namespace {
-template<typename HANDLE_T>
-inline void free_handle(HANDLE_T** h)
+namespace internal {
+/**
+ * Per libuv type description of the wrapper, specialized next to each wrapper class.
+ *
+ * callbacks_type lists the callback slots the wrapper uses.
+ */
+template<typename UV_T>
+struct handle_traits;
+
+/**
+ * State a wrapper keeps next to its callbacks, specialized by the wrappers which need some
+ */
+template<typename UV_T>
+struct handle_state
+{
+    struct type
+    {
+    };
+};
+
+/**
+ * The libuv struct together with the callback slots and state of its wrapper, allocated as a
+ * single block from the slab of its loop. The data member of the libuv struct points to the block.
+ *
+ * The block is reference counted: one reference is the wrapper's, the other libuv's, dropped when
+ * the close completes. So it's freed once both the wrapper is gone and the close has completed,
+ * in whichever order, and a close callback may destroy the wrapper.
+ */
+template<typename UV_T>
+struct handle_block
 {
-    if (*h == nullptr)
-        return;
+    typedef typename handle_traits<UV_T>::callbacks_type callbacks_type;
+    typedef typename handle_state<UV_T>::type state_type;
 
-    if ((*h)->data)
+    explicit handle_block(slab* s):
+        uv()
+        , tag(nullptr)
+        , owner(s)
+        , refs(2)
     {
-        delete reinterpret_cast<callbacks*>((*h)->data);
-        (*h)->data = nullptr;
     }
 
-    switch ((*h)->type)
+    /**
+     * Allocated from the slab of l, freed there by the last release. Requests, which aren't
+     * closed, only have their wrapper's reference.
+     */
+    static handle_block* create(uv_loop_t* l, unsigned refs = 2)
     {
-        case UV_TCP:
-            delete reinterpret_cast<uv_tcp_t*>(*h);
-            break;
+        handle_block* block = get_slab(l).create<handle_block>(&get_slab(l));
+        block->uv.data = block;
+        block->refs = refs;
+        return block;
+    }
 
-        case UV_UDP:
-            delete reinterpret_cast<uv_udp_t*>(*h);
-            break;
+    void release()
+    {
+        assert(refs);
+        if (--refs)
+            return;
+        owner->destroy(this);
+    }
 
-        case UV_NAMED_PIPE:
-            delete reinterpret_cast<uv_pipe_t*>(*h);
-            break;
+    UV_T uv;
+    callbacks_type callbacks;
+    state_type state;
+    /// see slow_callback
+    const char* tag;
+    /// slab of the loop, which may be gone by the last release
+    slab* owner;
+    unsigned refs;
+};
 
-        case UV_TTY:
-            delete reinterpret_cast<uv_tty_t*>(*h);
-            break;
+inline const char* uv_type_name(uv_handle_type type)
+{
+    return uv_handle_type_name(type);
+}
 
-        case UV_TIMER:
-            delete reinterpret_cast<uv_timer_t*>(*h);
-            break;
+inline const char* uv_type_name(uv_req_type type)
+{
+    return uv_req_type_name(type);
+}
 
-        case UV_SIGNAL:
-            delete reinterpret_cast<uv_signal_t*>(*h);
-            break;
+/**
+ * The callback slots of a handle_block as the libuv callbacks see them. Invoking goes through the
+ * dispatch hooks of the running loop, if it has any, which count and time the callbacks.
+ */
+template<typename BLOCK_T>
+class dispatcher
+{
+public:
+    typedef typename BLOCK_T::callbacks_type callbacks_type;
 
-        case UV_POLL:
-            delete reinterpret_cast<uv_poll_t*>(*h);
-            break;
+    explicit dispatcher(BLOCK_T& block):
+        m_block(block)
+    {
+    }
 
-        case UV_ASYNC:
-            delete reinterpret_cast<uv_async_t*>(*h);
-            break;
+    template<int cid, typename callback_t>
+    void store(callback_t&& callback)
+    {
+        m_block.callbacks.template store<cid>(std::forward<callback_t>(callback));
+    }
 
-        case UV_IDLE:
-            delete reinterpret_cast<uv_idle_t*>(*h);
-            break;
+    template<int cid, typename ...A>
+    typename callbacks_type::template slot<cid>::result_type invoke(A&& ... args)
+    {
+        return call<cid>(m_block.callbacks.template get<cid>(), std::forward<A>(args)...);
+    }
 
-        case UV_FS_EVENT:
-            delete reinterpret_cast<uv_fs_event_t*>(*h);
-            break;
+    template<int cid>
+    typename callbacks_type::template slot<cid>::type& get()
+    {
+        return m_block.callbacks.template get<cid>();
+    }
 
-        default:
-            assert(0);
-            throw std::runtime_error("free_handle can't handle this type");
-            break;
-            *h = nullptr;
+    /**
+     * Calls f as callback cid of the handle, for the callbacks kept outside the slots such as
+     * those of write requests, so that they're counted and timed like the others
+     */
+    template<int cid, typename F, typename ...A>
+    auto call(F& f, A&& ... args) -> decltype(f(std::forward<A>(args)...))
+    {
+        dispatch_hooks* hooks = current_dispatch_hooks();
+        if (! hooks)
+            return f(std::forward<A>(args)...);
+
+        if (hooks->counters)
+            hooks->counters->count(cid);
+        if (! hooks->slow || ! hooks->slow->sample())
+            return f(std::forward<A>(args)...);
+
+        // the callback may free the block, what's reported is taken before
+        timed_dispatch timed(*hooks, uv_type_name(m_block.uv.type), static_cast<uv_callback_id>(cid), m_block.tag);
+        return f(std::forward<A>(args)...);
     }
-}
 
+private:
+    BLOCK_T& m_block;
+};
 }
 
 /**
  * Wraps a libuv's uv_handle_t, or derived such as uv_stream_t, uv_tcp_t etc.
  *
- * Resources are released on the close call as mandated by libuv and NOT on the dtor
+ * Resources are released once the close completes as mandated by libuv. A wrapper destroyed
+ * without being closed closes its handle, which completes on the next loop iteration, so it has
+ * to be destroyed before its loop.
  */
 template<typename HANDLE_T>
 class handle
 {
 protected:
-    handle():
-        m_uv_handle(new HANDLE_T())
+    typedef internal::handle_block<HANDLE_T> block_type;
+    typedef typename block_type::callbacks_type callbacks_type;
+    typedef typename block_type::state_type state_type;
+
+    /// the derived class initializes the libuv handle on l
+    explicit handle(uv_loop_t* l):
+        m_uv_handle(&block_type::create(l)->uv)
         , m_will_close(false)
     {
-        assert(m_uv_handle);
-        m_uv_handle->data = new callbacks();
-        assert(m_uv_handle->data);
     }
 
     handle(handle&& other):
@@ -99,6 +180,7 @@ protected:
     {
         if (this == &other)
             return *this;
+        reset();
         m_uv_handle = other.m_uv_handle;
         m_will_close = other.m_will_close;
         other.m_uv_handle = nullptr;
@@ -108,13 +190,27 @@ protected:
 
     virtual ~handle()
     {
-        if (! m_will_close)
-            free_handle(&m_uv_handle);
+        reset();
     }
 
     handle(const handle&) = delete;
     handle& operator=(const handle&) = delete;
 
+    /**
+     * Callback slots of the handle from its data member, usable from the libuv callbacks
+     */
+    static internal::dispatcher<block_type> slots(void* data)
+    {
+        assert(data);
+        return internal::dispatcher<block_type>(*static_cast<block_type*>(data));
+    }
+
+    static state_type& state(void* data)
+    {
+        assert(data);
+        return static_cast<block_type*>(data)->state;
+    }
+
 public:
     template<typename T=HANDLE_T>
     T* get()
@@ -128,6 +224,15 @@ public:
         return reinterpret_cast<const T*>(m_uv_handle);
     }
 
+    /**
+     * Names the handle in slow_callback reports, tag has to outlive the handle: typically a
+     * string literal
+     */
+    void set_tag(const char* tag)
+    {
+        static_cast<block_type*>(m_uv_handle->data)->tag = tag;
+    }
+
     bool is_active() const
     {
         return uv_is_active(reinterpret_cast<const uv_handle_t*>(m_uv_handle)) != 0;
@@ -140,20 +245,35 @@ public:
             return; // prevent assertion on double close
         }
 
-        callbacks::store(get()->data, internal::uv_cid_close, callback);
+        slots(get()->data).template store<internal::uv_cid_close>(std::move(callback));
         m_will_close = true;
         uv_close(get<uv_handle_t>(),
                  [](uv_handle_t* h)
         {
-            callbacks::invoke<decltype(callback)>(h->data, internal::uv_cid_close);
-            free_handle(&h);
+            block_type* block = static_cast<block_type*>(h->data);
+            slots(h->data).template invoke<internal::uv_cid_close>();
+            block->release();
         });
     }
 
 protected:
     HANDLE_T* m_uv_handle;
     bool m_will_close;
+
+private:
+    /// closes the handle if needed and drops the wrapper's reference to its block
+    void reset()
+    {
+        if (! m_uv_handle)
+            return;
+        block_type* block = static_cast<block_type*>(m_uv_handle->data);
+        if (block->uv.type == UV_UNKNOWN_HANDLE)
+            block->release(); // its init failed, libuv never had it
+        else if (! m_will_close)
+            close();
+        block->release();
+        m_uv_handle = nullptr;
+    }
 };
 
 }
-
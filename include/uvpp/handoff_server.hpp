@@ -0,0 +1,395 @@
+#pragma once
+
+#include "tcp.hpp"
+#include "pipe.hpp"
+#include "async.hpp"
+#include "loop.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace uvpp {
+/**
+ * Tcp server where one acceptor loop accepts the connections and hands each one over to one of
+ * several worker loops, every loop on its own thread. Unlike SO_REUSEPORT, see sharded_server,
+ * the worker is chosen per connection, round robin or the one with the fewest connections, which
+ * keeps the load even when connections live for very different times.
+ *
+ * Sockets travel over an fd_pass Pipe per worker. The connection callback runs on the worker's
+ * thread once per received socket and takes it with channel.accept_pending into a Tcp of that
+ * loop. For least_connections the worker reports closed connections with connection_closed.
+ *
+ * stop() can be called from any thread: the acceptor closes its listener, every worker closes its
+ * channel and calls the stop callback, which must close the connections of that loop.
+ */
+class handoff_server
+{
+public:
+    enum policy
+    {
+        round_robin,
+        least_connections
+    };
+
+    typedef std::function<void(size_t index, loop& l, Pipe& channel)> connection_callback;
+    typedef std::function<void(size_t index, loop& l)> stop_callback;
+
+    /// workers defaults to the number of hardware threads
+    explicit handoff_server(size_t workers = 0, policy p = least_connections):
+        m_workers(workers ? workers : std::max(1u, std::thread::hardware_concurrency()))
+        , m_policy(p)
+        , m_next(0)
+        , m_port(0)
+    {
+    }
+
+    ~handoff_server()
+    {
+        stop();
+        join();
+    }
+
+    handoff_server(const handoff_server&) = delete;
+    handoff_server& operator=(const handoff_server&) = delete;
+
+    /// set before start, called on each worker's thread when stopping
+    void on_stop(stop_callback callback)
+    {
+        m_on_stop = std::move(callback);
+    }
+
+    /**
+     * Starts the workers and then the acceptor, returning once it's listening or something
+     * failed, in which case whatever was started is stopped. With port 0 a port is picked, see
+     * port().
+     */
+    error start(const std::string& ip, int port, connection_callback callback, int backlog = 128)
+    {
+        assert(callback);
+        m_on_connection = std::move(callback);
+        m_port = port;
+
+        int res = 0;
+        for (worker& w : m_workers)
+        {
+            if (res == 0)
+                res = uv_socketpair(SOCK_STREAM, 0, w.channel, 0, 0);
+        }
+
+        for (size_t i = 0; i < m_workers.size() && res == 0; ++i)
+        {
+            std::promise<int> ready;
+            std::future<int> result = ready.get_future();
+            m_workers[i].thread = std::thread(&handoff_server::run_worker, this, i, std::ref(ready));
+            res = result.get();
+        }
+
+        if (res == 0)
+        {
+            std::promise<int> ready;
+            std::future<int> result = ready.get_future();
+            m_acceptor.thread = std::thread(&handoff_server::run_acceptor, this, ip, backlog, std::ref(ready));
+            res = result.get();
+        }
+
+        if (res != 0)
+        {
+            stop();
+            join();
+            for (worker& w : m_workers)
+            {
+                close_socket(w.channel[0]);
+                close_socket(w.channel[1]);
+            }
+        }
+        return error(res);
+    }
+
+    /// asks the acceptor and every worker to stop, thread safe
+    void stop()
+    {
+        // workers stop after the acceptor closed its end of the channels, so that it never
+        // writes to a closed one
+        if (! m_acceptor.stop())
+            stop_workers();
+    }
+
+    /// waits for the threads of the loops to finish
+    void join()
+    {
+        if (m_acceptor.thread.joinable())
+            m_acceptor.thread.join();
+        for (worker& w : m_workers)
+        {
+            if (w.thread.joinable())
+                w.thread.join();
+        }
+    }
+
+    /// a connection handed to worker index was closed, thread safe
+    void connection_closed(size_t index)
+    {
+        assert(m_workers[index].connections > 0);
+        --m_workers[index].connections;
+    }
+
+    /// connections handed to worker index and not yet reported closed
+    size_t connections(size_t index) const
+    {
+        return m_workers[index].connections;
+    }
+
+    size_t size() const
+    {
+        return m_workers.size();
+    }
+
+    /// port of the listener, valid after start
+    int port() const
+    {
+        return m_port;
+    }
+
+private:
+    /// thread running a loop which stops when its Async is signalled
+    struct loop_thread
+    {
+        loop_thread():
+            stopper(nullptr)
+        {
+        }
+
+        /// false if the loop isn't running
+        bool stop()
+        {
+            std::lock_guard<std::mutex> l(lock);
+            if (stopper)
+                stopper->send();
+            return stopper != nullptr;
+        }
+
+        void set_stopper(Async* a)
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stopper = a;
+        }
+
+        std::thread thread;
+        std::mutex lock;
+        /// Async of the running loop, null once it's stopping
+        Async* stopper;
+    };
+
+    struct worker : loop_thread
+    {
+        worker():
+            connections(0)
+        {
+            channel[0] = channel[1] = invalid_socket();
+        }
+
+        std::atomic<size_t> connections;
+        /// socket pair, the acceptor's end first; invalid once a Pipe owns it
+        uv_os_sock_t channel[2];
+    };
+
+    void run_worker(size_t index, std::promise<int>& ready)
+    {
+        worker& w = m_workers[index];
+        loop l;
+        Pipe channel(l, true);
+        Async stopper(l, [&]()
+        {
+            w.set_stopper(nullptr);
+            channel.close();
+            stopper.close();
+            if (m_on_stop)
+                m_on_stop(index, l);
+        });
+
+        int res = open(channel, w.channel[1]);
+        if (res == 0)
+        {
+            res = channel.read_start_status([&, index](const char*, ssize_t len)
+            {
+                if (len < 0)
+                    return;
+                // one byte and one socket per connection
+                for (int n = channel.pending_count(); n > 0; --n)
+                    m_on_connection(index, l, channel);
+            });
+        }
+        if (res != 0)
+        {
+            channel.close();
+            stopper.close();
+            l.run();
+            ready.set_value(res);
+            return;
+        }
+
+        w.set_stopper(&stopper);
+        ready.set_value(0);
+        l.run();
+    }
+
+    void run_acceptor(std::string ip, int backlog, std::promise<int>& ready)
+    {
+        loop l;
+        const bool ip6 = ip.find(':') != std::string::npos;
+        Tcp listener(l);
+        std::vector<std::unique_ptr<Pipe>> channels;
+        int res = 0;
+        for (worker& w : m_workers)
+        {
+            channels.emplace_back(new Pipe(l, true));
+            const int r = open(*channels.back(), w.channel[0]);
+            res = res ? res : r;
+        }
+
+        Async stopper(l, [&]()
+        {
+            listener.close();
+            for (std::unique_ptr<Pipe>& c : channels)
+                c->close();
+            stopper.close();
+            m_acceptor.set_stopper(nullptr);
+            stop_workers();
+        });
+
+        if (res == 0)
+            res = bind(listener, ip, ip6);
+        if (res == 0)
+        {
+            res = listener.listen_status([&](error err)
+            {
+                if (! err)
+                    hand_off(l, listener, channels);
+            }, backlog);
+        }
+        if (res != 0)
+        {
+            listener.close();
+            for (std::unique_ptr<Pipe>& c : channels)
+                c->close();
+            stopper.close();
+            l.run();
+            ready.set_value(res);
+            return;
+        }
+
+        m_acceptor.set_stopper(&stopper);
+        ready.set_value(0);
+        l.run();
+    }
+
+    void stop_workers()
+    {
+        for (worker& w : m_workers)
+            w.stop();
+    }
+
+    void hand_off(loop& l, Tcp& listener, std::vector<std::unique_ptr<Pipe>>& channels)
+    {
+        Tcp* conn = new Tcp(l);
+        auto release = [conn]()
+        {
+            conn->close([conn]() { delete conn; });
+        };
+        if (! listener.accept(*conn))
+        {
+            release();
+            return;
+        }
+
+        const size_t index = pick();
+        ++m_workers[index].connections;
+        static const char token = 'c';
+        // the worker got its own copy of the socket once the write completes
+        if (! channels[index]->write2(&token, 1, *conn, [release](error) { release(); }))
+        {
+            --m_workers[index].connections;
+            release();
+        }
+    }
+
+    size_t pick()
+    {
+        if (m_policy == round_robin)
+            return m_next++ % m_workers.size();
+
+        size_t best = 0;
+        for (size_t i = 1; i < m_workers.size(); ++i)
+        {
+            if (m_workers[i].connections < m_workers[best].connections)
+                best = i;
+        }
+        return best;
+    }
+
+    /// binds the listener, setting m_port if it was 0; returns a libuv error code
+    int bind(Tcp& listener, const std::string& ip, bool ip6)
+    {
+        sockaddr_storage addr;
+        int res = ip6
+                  ? uv_ip6_addr(ip.c_str(), m_port, reinterpret_cast<sockaddr_in6*>(&addr))
+                  : uv_ip4_addr(ip.c_str(), m_port, reinterpret_cast<sockaddr_in*>(&addr));
+        if (res == 0)
+            res = uv_tcp_bind(listener.get(), reinterpret_cast<sockaddr*>(&addr), 0);
+        if (res != 0 || m_port != 0)
+            return res;
+
+        int len = sizeof(addr);
+        res = uv_tcp_getsockname(listener.get(), reinterpret_cast<sockaddr*>(&addr), &len);
+        if (res == 0)
+            m_port = ntohs(ip6 ? reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port : reinterpret_cast<sockaddr_in*>(&addr)->sin_port);
+        return res;
+    }
+
+    /// hands sock over to channel, which owns it from then on
+    static int open(Pipe& channel, uv_os_sock_t& sock)
+    {
+        const int res = uv_pipe_open(channel.get(), static_cast<uv_file>(sock));
+        if (res != 0)
+            return res;
+        sock = invalid_socket();
+        return 0;
+    }
+
+    static uv_os_sock_t invalid_socket()
+    {
+        return static_cast<uv_os_sock_t>(-1);
+    }
+
+    static void close_socket(uv_os_sock_t& sock)
+    {
+        if (sock == invalid_socket())
+            return;
+#ifdef _WIN32
+        closesocket(sock);
+#else
+        ::close(sock);
+#endif
+        sock = invalid_socket();
+    }
+
+    std::vector<worker> m_workers;
+    loop_thread m_acceptor;
+    policy m_policy;
+    /// only used from the acceptor's thread
+    size_t m_next;
+    int m_port;
+    connection_callback m_on_connection;
+    stop_callback m_on_stop;
+};
+}
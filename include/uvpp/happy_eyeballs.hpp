@@ -0,0 +1,195 @@
+#pragma once
+
+#include "tcp.hpp"
+#include "timer.hpp"
+#include "dns_cache.hpp"
+#include "loop.hpp"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace uvpp {
+/// the connected Tcp, null when every address failed
+typedef std::function<void(error err, std::unique_ptr<Tcp> conn)> connect_any_callback;
+
+namespace internal {
+/**
+ * Connection attempts of one connect_any, deleting itself once the attempts that lost and its
+ * timer are closed
+ */
+class connect_race
+{
+public:
+    connect_race(loop& l, const address_list& addresses, int port, connect_any_callback callback, std::chrono::milliseconds delay):
+        m_loop(l)
+        , m_addresses(interleave(addresses))
+        , m_port(port)
+        , m_callback(std::move(callback))
+        , m_delay(static_cast<uint64_t>(delay.count()))
+        , m_timer(l)
+        , m_next(0)
+        , m_running(0)
+        , m_closing(0)
+        , m_status(UV_EAI_NODATA)
+        , m_done(false)
+    {
+    }
+
+    connect_race(const connect_race&) = delete;
+    connect_race& operator=(const connect_race&) = delete;
+
+    void start()
+    {
+        // one timer callback for the whole race, each failure restarts its period
+        m_timer.start([this]() { attempt_next(); }, m_delay, m_delay);
+        attempt_next();
+    }
+
+private:
+    /**
+     * RFC 8305 section 4: alternate the address families, starting with the resolver's first
+     * choice, so that a family which is broken as a whole costs a single delay
+     */
+    static address_list interleave(const address_list& addresses)
+    {
+        if (addresses.empty())
+            return addresses;
+        address_list first, second;
+        for (const sockaddr_storage& addr : addresses)
+            (addr.ss_family == addresses.front().ss_family ? first : second).push_back(addr);
+        address_list result;
+        for (size_t i = 0; i < first.size() || i < second.size(); ++i)
+        {
+            if (i < first.size())
+                result.push_back(first[i]);
+            if (i < second.size())
+                result.push_back(second[i]);
+        }
+        return result;
+    }
+
+    void attempt_next()
+    {
+        while (m_next < m_addresses.size())
+        {
+            const sockaddr_storage addr = with_port(m_addresses[m_next++], m_port);
+            m_attempts.emplace_back(new Tcp(m_loop));
+            Tcp* attempt = m_attempts.back().get();
+            const int res = attempt->connect_status(reinterpret_cast<const sockaddr*>(&addr), [this, attempt](error err) { connected(attempt, err); });
+            if (res == 0)
+            {
+                ++m_running;
+                if (m_next == m_addresses.size())
+                    m_timer.stop();
+                return;
+            }
+            m_status = res;
+            close(*attempt);
+        }
+
+        m_timer.stop();
+        if (! m_running)
+            finish(error(m_status), nullptr);
+    }
+
+    void connected(Tcp* attempt, error err)
+    {
+        --m_running;
+        // a loser closed while connecting
+        if (m_done)
+            return;
+
+        if (err)
+        {
+            m_status = err.code();
+            close(*attempt);
+            attempt_next();
+            if (m_next < m_addresses.size())
+                m_timer.again();
+            return;
+        }
+
+        std::unique_ptr<Tcp> winner;
+        for (std::unique_ptr<Tcp>& a : m_attempts)
+        {
+            if (a.get() == attempt)
+                winner = std::move(a);
+        }
+        finish(error(0), std::move(winner));
+    }
+
+    void finish(error err, std::unique_ptr<Tcp> conn)
+    {
+        m_done = true;
+        for (std::unique_ptr<Tcp>& a : m_attempts)
+        {
+            if (a && ! uv_is_closing(a->get<uv_handle_t>()))
+                close(*a);
+        }
+        ++m_closing;
+        m_timer.close([this]() { closed_one(); });
+
+        connect_any_callback callback(std::move(m_callback));
+        callback(err, std::move(conn));
+    }
+
+    void close(Tcp& attempt)
+    {
+        ++m_closing;
+        attempt.close([this]() { closed_one(); });
+    }
+
+    void closed_one()
+    {
+        if (--m_closing == 0 && m_done)
+            delete this;
+    }
+
+    loop& m_loop;
+    address_list m_addresses;
+    int m_port;
+    connect_any_callback m_callback;
+    std::chrono::duration<uint64_t, std::milli> m_delay;
+    Timer m_timer;
+    std::vector<std::unique_ptr<Tcp>> m_attempts;
+    size_t m_next;
+    size_t m_running;
+    size_t m_closing;
+    int m_status;
+    bool m_done;
+};
+}
+
+/**
+ * Happy eyeballs connect (RFC 8305) to the addresses of a host: the address families are
+ * interleaved, an attempt starts every delay, or right away when the previous one fails, and the
+ * first connection established wins, the other attempts are cancelled. A blackholed address then
+ * costs delay rather than a connect timeout.
+ *
+ * The addresses may have port 0, they're connected to on port. callback gets the error of the
+ * last attempt when all fail, UV_EAI_NODATA if there's no address.
+ */
+inline void connect_any(loop& l, const address_list& addresses, int port, connect_any_callback callback,
+                        std::chrono::milliseconds delay = std::chrono::milliseconds(250))
+{
+    assert(callback);
+    (new internal::connect_race(l, addresses, port, std::move(callback), delay))->start();
+}
+
+/// resolves host through dns and connects to its addresses with connect_any
+inline void connect_any(loop& l, dns_cache& dns, const std::string& host, int port, connect_any_callback callback,
+                        std::chrono::milliseconds delay = std::chrono::milliseconds(250))
+{
+    assert(callback);
+    dns.resolve(host, [&l, port, callback, delay](error err, const address_list& addresses)
+    {
+        if (err)
+            callback(err, nullptr);
+        else
+            connect_any(l, addresses, port, callback, delay);
+    });
+}
+}
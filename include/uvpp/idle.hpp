@@ -1,21 +1,29 @@
 #pragma once
 
-#include "request.hpp"
+#include "handle.hpp"
 #include "error.hpp"
 #include "loop.hpp"
 
 namespace uvpp {
+namespace internal {
+template<>
+struct handle_traits<uv_idle_t>
+{
+    typedef callback_slots<uv_cid_close, uv_cid_idle> callbacks_type;
+};
+}
+
 class Idle : public handle<uv_idle_t>
 {
 public:
     Idle(Callback callback):
-        handle<uv_idle_t>(), loop_(uv_default_loop())
+        handle<uv_idle_t>(uv_default_loop()), loop_(uv_default_loop())
     {
         init(loop_, callback);
     }
 
     Idle(loop& l, Callback callback):
-        handle<uv_idle_t>(), loop_(l.get())
+        handle<uv_idle_t>(l.get()), loop_(l.get())
     {
         init(loop_, callback);
     }
@@ -24,7 +32,7 @@ public:
     {
         return error(uv_idle_start(get(), [](uv_idle_t* req)
         {
-            callbacks::invoke<Callback>(req->data, internal::uv_cid_idle);
+            slots(req->data).invoke<internal::uv_cid_idle>();
         }));
 
     }
@@ -38,7 +46,7 @@ private:
 
     void init(uv_loop_t *loop, Callback callback)
     {
-        callbacks::store(get()->data, internal::uv_cid_idle, callback);
+        slots(get()->data).store<internal::uv_cid_idle>(callback);
         uv_idle_init(loop, get());
     }
 
@@ -1,11 +1,198 @@
 #pragma once
 
 #include "error.hpp"
+#include "metrics.hpp"
+#include "pool.hpp"
 
 #include <memory>
 #include <functional>
 
 namespace uvpp {
+namespace internal {
+/**
+ * Intrusive node of the end of tick list of a loop, see tick_hooks
+ */
+struct tick_node
+{
+    tick_node():
+        prev(this)
+        , next(this)
+        , run(nullptr)
+        , data(nullptr)
+    {
+    }
+
+    ~tick_node()
+    {
+        unlink();
+    }
+
+    tick_node(const tick_node&) = delete;
+    tick_node& operator=(const tick_node&) = delete;
+
+    bool linked() const
+    {
+        return next != this;
+    }
+
+    void unlink()
+    {
+        prev->next = next;
+        next->prev = prev;
+        prev = next = this;
+    }
+
+    void link_before(tick_node* pos)
+    {
+        prev = pos->prev;
+        next = pos;
+        pos->prev->next = this;
+        pos->prev = this;
+    }
+
+    tick_node* prev;
+    tick_node* next;
+    void (*run)(tick_node*);
+    void* data;
+};
+
+/**
+ * Runs the scheduled tick_nodes at the end of the current loop iteration: from a check handle
+ * right after the I/O callbacks, and from a prepare handle before polling so that nodes scheduled
+ * by timers don't wait for the loop to block. The handles don't keep the loop alive and are only
+ * active while nodes are scheduled.
+ */
+class tick_hooks
+{
+public:
+    explicit tick_hooks(uv_loop_t* l)
+    {
+        uv_prepare_init(l, &m_prepare);
+        uv_check_init(l, &m_check);
+        m_prepare.data = this;
+        m_check.data = this;
+        uv_unref(reinterpret_cast<uv_handle_t*>(&m_prepare));
+        uv_unref(reinterpret_cast<uv_handle_t*>(&m_check));
+    }
+
+    ~tick_hooks()
+    {
+        while (m_pending.linked())
+            m_pending.next->unlink();
+    }
+
+    tick_hooks(const tick_hooks&) = delete;
+    tick_hooks& operator=(const tick_hooks&) = delete;
+
+    /// n->run(n) will be called once at the end of this iteration, unless unlinked before
+    void schedule(tick_node* n)
+    {
+        assert(n->run);
+        if (n->linked())
+            return;
+        const bool start = ! m_pending.linked();
+        n->link_before(&m_pending);
+        if (start)
+        {
+            uv_prepare_start(&m_prepare, [](uv_prepare_t* h) { static_cast<tick_hooks*>(h->data)->run(); });
+            uv_check_start(&m_check, [](uv_check_t* h) { static_cast<tick_hooks*>(h->data)->run(); });
+        }
+    }
+
+    /// closes the handles, the loop has to run once more before destroying the tick_hooks
+    void close()
+    {
+        uv_close(reinterpret_cast<uv_handle_t*>(&m_prepare), nullptr);
+        uv_close(reinterpret_cast<uv_handle_t*>(&m_check), nullptr);
+    }
+
+private:
+    void run()
+    {
+        // nodes scheduled while running wait for the next hook
+        tick_node batch;
+        if (m_pending.linked())
+        {
+            batch.next = m_pending.next;
+            batch.prev = m_pending.prev;
+            batch.next->prev = &batch;
+            batch.prev->next = &batch;
+            m_pending.next = m_pending.prev = &m_pending;
+        }
+
+        while (batch.linked())
+        {
+            tick_node* n = batch.next;
+            n->unlink();
+            n->run(n);
+        }
+
+        if (! m_pending.linked())
+        {
+            uv_prepare_stop(&m_prepare);
+            uv_check_stop(&m_check);
+        }
+    }
+
+    uv_prepare_t m_prepare;
+    uv_check_t m_check;
+    tick_node m_pending;
+};
+
+/**
+ * State shared by the wrappers of one loop, hung from uv_loop_t::data which is reserved for uvpp.
+ */
+struct loop_data
+{
+    loop_data():
+        blocks(new slab())
+    {
+    }
+
+    ~loop_data()
+    {
+        blocks->detach();
+    }
+
+    loop_data(const loop_data&) = delete;
+    loop_data& operator=(const loop_data&) = delete;
+
+    slab* blocks;
+    buffer_pool read_buffers;
+    std::unique_ptr<tick_hooks> ticks;
+    std::unique_ptr<loop_metrics> metrics;
+    std::unique_ptr<slow_callback_detector> slow_callbacks;
+    /// points into metrics and slow_callbacks
+    dispatch_hooks hooks;
+};
+
+/**
+ * Returns the loop_data of l, creating it on first use. It's released by the uvpp::loop owning l,
+ * the one of a default loop not wrapped by uvpp::loop lives until exit.
+ */
+inline loop_data& get_loop_data(uv_loop_t* l)
+{
+    assert(l);
+    if (! l->data)
+        l->data = new loop_data();
+    return *static_cast<loop_data*>(l->data);
+}
+
+/// the slab requests and handle blocks of l are allocated from
+inline slab& get_slab(uv_loop_t* l)
+{
+    return *get_loop_data(l).blocks;
+}
+
+inline tick_hooks& get_tick_hooks(uv_loop_t* l)
+{
+    loop_data& data = get_loop_data(l);
+    if (! data.ticks)
+        data.ticks.reset(new tick_hooks(l));
+    return *data.ticks;
+}
+}
+
 /**
  *  Class that represents the uv_loop instance.
  */
@@ -18,7 +205,7 @@ public:
      */
     loop(bool use_default=false)
         : default_loop(use_default)
-        , m_uv_loop(use_default ? uv_default_loop() : new uv_loop_t
+        , m_uv_loop(use_default ? uv_default_loop() : new uv_loop_t()
                     ,   [this](uv_loop_t *loop)
     {
         destroy(loop);
@@ -37,8 +224,24 @@ public:
     {
         if (m_uv_loop.get())
         {
+            internal::loop_data* data = static_cast<internal::loop_data*>(m_uv_loop->data);
+            if (data && data->ticks)
+                data->ticks->close();
+            if (data && data->metrics)
+                data->metrics->close();
+            // completes those closes and the ones of handles whose wrapper was destroyed unclosed
+            bool closing = false;
+            uv_walk(m_uv_loop.get(), [](uv_handle_t* h, void* arg)
+            {
+                if (uv_is_closing(h))
+                    *static_cast<bool*>(arg) = true;
+            }, &closing);
+            if (closing)
+                uv_run(m_uv_loop.get(), UV_RUN_NOWAIT);
             // no matter default loop or not: http://nikhilm.github.io/uvbook/basics.html#event-loops
             uv_loop_close(m_uv_loop.get());
+            delete data;
+            m_uv_loop->data = nullptr;
         }
     }
 
@@ -72,7 +275,7 @@ public:
      */
     bool run()
     {
-        return uv_run(m_uv_loop.get(), UV_RUN_DEFAULT) == 0;
+        return run_mode(UV_RUN_DEFAULT);
     }
 
     /**
@@ -80,7 +283,7 @@ public:
      */
     bool run_once()
     {
-        return uv_run(m_uv_loop.get(), UV_RUN_ONCE) == 0;
+        return run_mode(UV_RUN_ONCE);
     }
 
     /**
@@ -88,7 +291,7 @@ public:
      */
     bool run_nowait()
     {
-        return uv_run(m_uv_loop.get(), UV_RUN_NOWAIT) == 0;
+        return run_mode(UV_RUN_NOWAIT);
     }
 
     /**
@@ -117,7 +320,71 @@ public:
         uv_stop(m_uv_loop.get());
     }
 
+    /**
+     * Pool of the buffers streams of this loop read into by default, see stream::read_start
+     */
+    buffer_pool& read_buffers()
+    {
+        return internal::get_loop_data(m_uv_loop.get()).read_buffers;
+    }
+
+    /**
+     * Slab the write, connect, shutdown and fs requests and the handle blocks of this loop are
+     * allocated from, see slab
+     */
+    uvpp::slab& requests()
+    {
+        return internal::get_slab(m_uv_loop.get());
+    }
+
+    /**
+     * Starts collecting loop_metrics, from the loop's thread. They stay on until the loop is
+     * destroyed, the returned object can be read from any thread until then.
+     */
+    loop_metrics& enable_metrics()
+    {
+        internal::loop_data& data = internal::get_loop_data(m_uv_loop.get());
+        if (! data.metrics)
+        {
+            data.metrics.reset(new loop_metrics(m_uv_loop.get()));
+            data.hooks.counters = &data.metrics->counters();
+        }
+        return *data.metrics;
+    }
+
+    /// null unless enabled
+    loop_metrics* metrics()
+    {
+        internal::loop_data* data = static_cast<internal::loop_data*>(m_uv_loop->data);
+        return data ? data->metrics.get() : nullptr;
+    }
+
+    /**
+     * Reports the callbacks of this loop's wrappers running for threshold or longer, timing one in
+     * sample_every of them, see slow_callback_detector. Replaces the previous detector, an empty
+     * report turns detection off. From the loop's thread.
+     */
+    void detect_slow_callbacks(std::chrono::nanoseconds threshold, slow_callback_detector::report_callback report, unsigned sample_every = 1)
+    {
+        internal::loop_data& data = internal::get_loop_data(m_uv_loop.get());
+        data.slow_callbacks.reset(report ? new slow_callback_detector(threshold, std::move(report), sample_every) : nullptr);
+        data.hooks.slow = data.slow_callbacks.get();
+    }
+
 private:
+    /**
+     * Runs with the dispatch hooks of the loop as the current ones, even empty: they may be set by
+     * its callbacks, and a loop run from a callback of another mustn't use the other's
+     */
+    bool run_mode(uv_run_mode mode)
+    {
+        internal::dispatch_hooks*& current = internal::current_dispatch_hooks();
+        internal::dispatch_hooks* const previous = current;
+        current = &internal::get_loop_data(m_uv_loop.get()).hooks;
+        const int r = uv_run(m_uv_loop.get(), mode);
+        current = previous;
+        return r == 0;
+    }
 
     // Custom deleter
     typedef std::function<void(uv_loop_t*)> Deleter;
@@ -0,0 +1,317 @@
+#pragma once
+
+#include "async.hpp"
+#include "callback.hpp"
+#include "loop.hpp"
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+
+namespace uvpp {
+namespace internal {
+/// keeps what producers and the consumer write on separate cache lines
+static const size_t cache_line_size = 64;
+
+/**
+ * Unbounded lock-free multiple producer single consumer queue, Dmitry Vyukov's intrusive node
+ * queue. push is a single exchange. pop may see the queue empty while a push is half done, the
+ * producer has to wake the consumer after pushing for it to look again.
+ */
+template<typename T>
+class mpsc_queue
+{
+public:
+    mpsc_queue():
+        m_head(&m_stub)
+        , m_tail(&m_stub)
+    {
+    }
+
+    ~mpsc_queue()
+    {
+        T value;
+        while (pop(value))
+        {
+        }
+    }
+
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    /// any thread
+    void push(T&& value)
+    {
+        push(new node(std::move(value)));
+    }
+
+    /// consumer thread only
+    bool pop(T& value)
+    {
+        node* tail = m_tail;
+        node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &m_stub)
+        {
+            if (! next)
+                return false;
+            m_tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (! next)
+        {
+            if (tail != m_head.load(std::memory_order_acquire))
+                return false;
+            push(&m_stub);
+            next = tail->next.load(std::memory_order_acquire);
+            if (! next)
+                return false;
+        }
+        m_tail = next;
+        value = std::move(tail->value);
+        delete tail;
+        return true;
+    }
+
+private:
+    struct node
+    {
+        node():
+            next(nullptr)
+        {
+        }
+
+        explicit node(T&& v):
+            next(nullptr)
+            , value(std::move(v))
+        {
+        }
+
+        std::atomic<node*> next;
+        T value;
+    };
+
+    void push(node* n)
+    {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        node* prev = m_head.exchange(n, std::memory_order_seq_cst);
+        prev->next.store(n, std::memory_order_seq_cst);
+    }
+
+    std::atomic<node*> m_head;
+    char m_pad[cache_line_size - sizeof(std::atomic<node*>)];
+    node* m_tail;
+    node m_stub;
+};
+
+/**
+ * Bounded lock-free multiple producer single consumer queue over a ring of capacity rounded up to
+ * a power of two, after Dmitry Vyukov's bounded queue. Neither side allocates.
+ */
+template<typename T>
+class bounded_mpsc_queue
+{
+public:
+    explicit bounded_mpsc_queue(size_t capacity):
+        m_mask(round_up(capacity) - 1)
+        , m_cells(new cell[m_mask + 1])
+        , m_enqueue(0)
+        , m_dequeue(0)
+    {
+        for (size_t i = 0; i <= m_mask; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bounded_mpsc_queue(const bounded_mpsc_queue&) = delete;
+    bounded_mpsc_queue& operator=(const bounded_mpsc_queue&) = delete;
+
+    /// any thread, false when full; value is only moved from on success
+    bool try_push(T&& value)
+    {
+        size_t pos = m_enqueue.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;)
+        {
+            c = &m_cells[pos & m_mask];
+            const size_t sequence = c->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+        c->value = std::move(value);
+        c->sequence.store(pos + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    /// consumer thread only
+    bool pop(T& value)
+    {
+        cell& c = m_cells[m_dequeue & m_mask];
+        const size_t sequence = c.sequence.load(std::memory_order_acquire);
+        if (sequence != m_dequeue + 1)
+            return false;
+        value = std::move(c.value);
+        c.sequence.store(m_dequeue + m_mask + 1, std::memory_order_release);
+        ++m_dequeue;
+        return true;
+    }
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t round_up(size_t n)
+    {
+        size_t result = 2;
+        while (result < n)
+            result *= 2;
+        return result;
+    }
+
+    const size_t m_mask;
+    std::unique_ptr<cell[]> m_cells;
+    std::atomic<size_t> m_enqueue;
+    char m_pad[cache_line_size - sizeof(std::atomic<size_t>)];
+    size_t m_dequeue;
+};
+}
+
+/**
+ * Runs tasks posted from any thread on the thread of a loop.
+ *
+ * Producers push onto a lock-free queue and wake the loop through a single Async, only when it's
+ * not already woken, and the loop runs the tasks in batches of up to batch_size before letting
+ * the I/O in. Producers never wait for the loop, except on a full bounded executor.
+ *
+ * With a capacity the queue is a fixed ring, which doesn't allocate, and post waits for room
+ * while try_post fails instead. Unbounded executors allocate one node per task.
+ *
+ * Like handles the executor has to be closed, from the loop's thread, before it's destroyed, and
+ * only once every post has returned. Tasks still queued then are destroyed without running.
+ */
+class loop_executor
+{
+public:
+    typedef internal::inline_callback<void()> task;
+
+    static const size_t batch_size = 1024;
+
+    /// capacity 0 makes an unbounded executor
+    explicit loop_executor(loop& l, size_t capacity = 0):
+        m_bounded(capacity ? new internal::bounded_mpsc_queue<task>(capacity) : nullptr)
+        , m_signaled(false)
+        , m_async(l, [this]() { drain(); })
+    {
+    }
+
+    loop_executor(const loop_executor&) = delete;
+    loop_executor& operator=(const loop_executor&) = delete;
+
+    /**
+     * Queues f to run on the loop's thread. On a full bounded executor waits for the loop to
+     * make room, so never call it from the loop's own thread on a bounded one.
+     */
+    template<typename F>
+    void post(F&& f)
+    {
+        task t;
+        t.assign(std::forward<F>(f));
+        if (m_bounded)
+        {
+            while (! m_bounded->try_push(std::move(t)))
+                std::this_thread::yield();
+        }
+        else
+        {
+            m_queue.push(std::move(t));
+        }
+        wake();
+    }
+
+    /// like post but fails rather than wait when a bounded executor is full
+    template<typename F>
+    bool try_post(F&& f)
+    {
+        task t;
+        t.assign(std::forward<F>(f));
+        if (m_bounded)
+        {
+            if (! m_bounded->try_push(std::move(t)))
+                return false;
+        }
+        else
+        {
+            m_queue.push(std::move(t));
+        }
+        wake();
+        return true;
+    }
+
+    /// 0 when unbounded
+    size_t capacity() const
+    {
+        return m_bounded ? m_bounded->capacity() : 0;
+    }
+
+    void close(Callback callback = [] {})
+    {
+        m_async.close(std::move(callback));
+    }
+
+private:
+    void wake()
+    {
+        if (! m_signaled.exchange(true, std::memory_order_seq_cst))
+            m_async.send();
+    }
+
+    bool pop(task& t)
+    {
+        return m_bounded ? m_bounded->pop(t) : m_queue.pop(t);
+    }
+
+    void drain()
+    {
+        // cleared before looking at the queue so that a task pushed from now on wakes us again
+        m_signaled.store(false, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        task t;
+        size_t n = 0;
+        while (n < batch_size && pop(t))
+        {
+            t();
+            t.reset();
+            ++n;
+        }
+        // there may be more, run them on the next iteration after the I/O
+        if (n == batch_size)
+            wake();
+    }
+
+    internal::mpsc_queue<task> m_queue;
+    std::unique_ptr<internal::bounded_mpsc_queue<task>> m_bounded;
+    std::atomic<bool> m_signaled;
+    Async m_async;
+};
+}
@@ -0,0 +1,394 @@
+#pragma once
+
+#include "callback.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdint.h>
+
+namespace uvpp {
+namespace internal {
+/**
+ * Number of callbacks dispatched per uv_callback_id, written from the loop's thread and readable
+ * from any thread, see loop_metrics
+ */
+struct callback_counters
+{
+    callback_counters()
+    {
+        for (std::atomic<uint64_t>& c : counts)
+            c.store(0, std::memory_order_relaxed);
+    }
+
+    callback_counters(const callback_counters&) = delete;
+    callback_counters& operator=(const callback_counters&) = delete;
+
+    void count(int cid)
+    {
+        // single writer, no need for a locked increment
+        counts[cid].store(counts[cid].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> counts[uv_cid_max];
+};
+}
+
+/**
+ * Log-linear histogram of durations in microseconds in the spirit of HdrHistogram: each power of
+ * two is split in sub_buckets linear buckets, so values are kept with a relative error under
+ * 1/sub_buckets from 1us to over an hour.
+ *
+ * Recorded from a single thread, counts are atomic so that any thread can read them without locks,
+ * a reader may see a record partially, in some counters and not yet in others.
+ */
+class latency_histogram
+{
+public:
+    static const unsigned sub_bucket_bits = 3;
+    static const unsigned sub_buckets = 1 << sub_bucket_bits;
+    static const unsigned max_bits = 32;
+    static const unsigned buckets = (max_bits - sub_bucket_bits + 1) * sub_buckets;
+
+    latency_histogram()
+    {
+        for (std::atomic<uint64_t>& c : m_counts)
+            c.store(0, std::memory_order_relaxed);
+        m_total.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+    latency_histogram(const latency_histogram&) = delete;
+    latency_histogram& operator=(const latency_histogram&) = delete;
+
+    /// the recording thread only
+    void record(uint64_t us)
+    {
+        increment(m_counts[index(us)]);
+        increment(m_total);
+        if (us > m_max.load(std::memory_order_relaxed))
+            m_max.store(us, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const
+    {
+        return m_total.load(std::memory_order_relaxed);
+    }
+
+    uint64_t max() const
+    {
+        return m_max.load(std::memory_order_relaxed);
+    }
+
+    /// upper bound of the bucket holding the q-th quantile, q in [0, 1], 0 when empty
+    uint64_t percentile(double q) const
+    {
+        uint64_t counts[buckets];
+        uint64_t total = 0;
+        for (unsigned i = 0; i < buckets; ++i)
+        {
+            counts[i] = m_counts[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (! total)
+            return 0;
+
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * total + 0.5));
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < buckets; ++i)
+        {
+            seen += counts[i];
+            if (seen >= rank)
+                return std::min(lower_bound(i + 1) - 1, max());
+        }
+        return max();
+    }
+
+    /// count of bucket i, which holds [lower_bound(i), lower_bound(i + 1))
+    uint64_t bucket(unsigned i) const
+    {
+        return m_counts[i].load(std::memory_order_relaxed);
+    }
+
+    static uint64_t lower_bound(unsigned i)
+    {
+        if (i < sub_buckets)
+            return i;
+        return static_cast<uint64_t>(sub_buckets + i % sub_buckets) << (i / sub_buckets - 1);
+    }
+
+    static unsigned index(uint64_t us)
+    {
+        if (us < sub_buckets)
+            return static_cast<unsigned>(us);
+        if (us >> max_bits)
+            return buckets - 1;
+        unsigned msb = 0;
+        while (us >> (msb + 1))
+            ++msb;
+        return (msb - sub_bucket_bits + 1) * sub_buckets + ((us >> (msb - sub_bucket_bits)) & (sub_buckets - 1));
+    }
+
+private:
+    static void increment(std::atomic<uint64_t>& c)
+    {
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> m_counts[buckets];
+    std::atomic<uint64_t> m_total;
+    std::atomic<uint64_t> m_max;
+};
+
+/**
+ * A callback which ran for longer than the threshold of the slow_callback_detector
+ */
+struct slow_callback
+{
+    /// libuv's name of the handle or request type, such as "tcp" or "fs"
+    const char* type;
+    internal::uv_callback_id id;
+    /// the tag of the handle or request, see handle::set_tag, nullptr if it has none
+    const char* tag;
+    uint64_t ns;
+};
+
+/**
+ * Times the callbacks dispatched by the wrappers of a loop and reports those running for longer
+ * than a threshold, enabled with loop::detect_slow_callbacks.
+ *
+ * Reading the clock twice per callback costs some tens of nanoseconds. With sample_every at n only
+ * one callback in n is timed, which keeps the detector cheap enough to stay on in production: a
+ * callback that is often slow is still caught, one slow only once in a while may be missed.
+ *
+ * Only used from the loop's thread, report is called right after the slow callback returns.
+ */
+class slow_callback_detector
+{
+public:
+    typedef std::function<void(const slow_callback&)> report_callback;
+
+    slow_callback_detector(std::chrono::nanoseconds threshold, report_callback report, unsigned sample_every = 1):
+        m_threshold(static_cast<uint64_t>(threshold.count()))
+        , m_report(std::move(report))
+        , m_every(std::max(sample_every, 1u))
+        , m_countdown(m_every)
+        , m_reported(0)
+    {
+        assert(m_report);
+    }
+
+    slow_callback_detector(const slow_callback_detector&) = delete;
+    slow_callback_detector& operator=(const slow_callback_detector&) = delete;
+
+    /// whether to time the next callback
+    bool sample()
+    {
+        if (--m_countdown)
+            return false;
+        m_countdown = m_every;
+        return true;
+    }
+
+    void check(uint64_t start, const char* type, internal::uv_callback_id id, const char* tag)
+    {
+        const uint64_t ns = uv_hrtime() - start;
+        if (ns < m_threshold)
+            return;
+        ++m_reported;
+        m_report(slow_callback { type, id, tag, ns });
+    }
+
+    /// slow callbacks reported so far
+    uint64_t reported() const
+    {
+        return m_reported;
+    }
+
+private:
+    uint64_t m_threshold;
+    report_callback m_report;
+    unsigned m_every;
+    unsigned m_countdown;
+    uint64_t m_reported;
+};
+
+namespace internal {
+/**
+ * What the wrappers' callback dispatch does besides calling the callback, per loop: counting for
+ * loop_metrics and timing for the slow_callback_detector
+ */
+struct dispatch_hooks
+{
+    dispatch_hooks():
+        counters(nullptr)
+        , slow(nullptr)
+    {
+    }
+
+    bool empty() const
+    {
+        return ! counters && ! slow;
+    }
+
+    callback_counters* counters;
+    slow_callback_detector* slow;
+};
+
+/**
+ * Hooks of the loop running on this thread, set by loop::run and its variants for the whole run,
+ * null outside of them
+ */
+inline dispatch_hooks*& current_dispatch_hooks()
+{
+    static thread_local dispatch_hooks* hooks = nullptr;
+    return hooks;
+}
+
+/**
+ * Times one callback, reporting it from the destructor so that it works whatever the callback
+ * returns. The hooks are looked up again then since the callback may have changed them.
+ */
+class timed_dispatch
+{
+public:
+    timed_dispatch(dispatch_hooks& hooks, const char* type, uv_callback_id id, const char* tag):
+        m_hooks(hooks)
+        , m_type(type)
+        , m_id(id)
+        , m_tag(tag)
+        , m_start(uv_hrtime())
+    {
+    }
+
+    ~timed_dispatch()
+    {
+        if (m_hooks.slow)
+            m_hooks.slow->check(m_start, m_type, m_id, m_tag);
+    }
+
+    timed_dispatch(const timed_dispatch&) = delete;
+    timed_dispatch& operator=(const timed_dispatch&) = delete;
+
+private:
+    dispatch_hooks& m_hooks;
+    const char* m_type;
+    uv_callback_id m_id;
+    const char* m_tag;
+    uint64_t m_start;
+};
+}
+
+/**
+ * Instrumentation of a loop, enabled with loop::enable_metrics.
+ *
+ * A prepare handle, running right before the loop polls, times the iterations and takes the time
+ * spent polling from uv_metrics_idle_time. What's left of an iteration is the time the loop was
+ * busy running callbacks, which is also the longest an event had to wait for the loop: it's
+ * recorded as the loop lag in a histogram. The callbacks dispatched by the wrappers are counted by
+ * uv_callback_id while the loop runs through loop::run and its variants.
+ *
+ * Everything is written from the loop's thread and can be read from any thread without locks. The
+ * handles don't keep the loop alive. A loop without metrics pays a null check per callback.
+ */
+class loop_metrics
+{
+public:
+    explicit loop_metrics(uv_loop_t* l):
+        m_loop(l)
+        , m_last_prepare(0)
+        , m_last_idle(0)
+    {
+        m_iterations.store(0, std::memory_order_relaxed);
+        m_last_iteration.store(0, std::memory_order_relaxed);
+        m_max_iteration.store(0, std::memory_order_relaxed);
+        m_idle.store(0, std::memory_order_relaxed);
+
+        uv_loop_configure(l, UV_METRICS_IDLE_TIME);
+        uv_prepare_init(l, &m_prepare);
+        m_prepare.data = this;
+        uv_unref(reinterpret_cast<uv_handle_t*>(&m_prepare));
+        uv_prepare_start(&m_prepare, [](uv_prepare_t* h) { static_cast<loop_metrics*>(h->data)->on_prepare(); });
+    }
+
+    loop_metrics(const loop_metrics&) = delete;
+    loop_metrics& operator=(const loop_metrics&) = delete;
+
+    /// iterations timed, the first one isn't
+    uint64_t iterations() const
+    {
+        return m_iterations.load(std::memory_order_relaxed);
+    }
+
+    /// duration of the last iteration, from one poll to the next
+    uint64_t last_iteration_ns() const
+    {
+        return m_last_iteration.load(std::memory_order_relaxed);
+    }
+
+    uint64_t max_iteration_ns() const
+    {
+        return m_max_iteration.load(std::memory_order_relaxed);
+    }
+
+    /// time spent polling since metrics were enabled, as of the last iteration
+    uint64_t idle_ns() const
+    {
+        return m_idle.load(std::memory_order_relaxed);
+    }
+
+    uint64_t callbacks(internal::uv_callback_id cid) const
+    {
+        return m_callbacks.counts[cid].load(std::memory_order_relaxed);
+    }
+
+    /// time busy between two polls, in microseconds
+    const latency_histogram& lag() const
+    {
+        return m_lag;
+    }
+
+    internal::callback_counters& counters()
+    {
+        return m_callbacks;
+    }
+
+    /// closes the handle, the loop has to run once more before destroying the metrics
+    void close()
+    {
+        uv_close(reinterpret_cast<uv_handle_t*>(&m_prepare), nullptr);
+    }
+
+private:
+    void on_prepare()
+    {
+        const uint64_t now = uv_hrtime();
+        const uint64_t idle = uv_metrics_idle_time(m_loop);
+        if (m_last_prepare)
+        {
+            const uint64_t iteration = now - m_last_prepare;
+            const uint64_t polled = idle - m_last_idle;
+            m_lag.record((iteration > polled ? iteration - polled : 0) / 1000);
+            m_last_iteration.store(iteration, std::memory_order_relaxed);
+            if (iteration > m_max_iteration.load(std::memory_order_relaxed))
+                m_max_iteration.store(iteration, std::memory_order_relaxed);
+            m_iterations.store(m_iterations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            m_idle.store(m_idle.load(std::memory_order_relaxed) + polled, std::memory_order_relaxed);
+        }
+        m_last_prepare = now;
+        m_last_idle = idle;
+    }
+
+    uv_loop_t* m_loop;
+    uv_prepare_t m_prepare;
+    uint64_t m_last_prepare;
+    uint64_t m_last_idle;
+    std::atomic<uint64_t> m_iterations;
+    std::atomic<uint64_t> m_last_iteration;
+    std::atomic<uint64_t> m_max_iteration;
+    std::atomic<uint64_t> m_idle;
+    internal::callback_counters m_callbacks;
+    latency_histogram m_lag;
+};
+}
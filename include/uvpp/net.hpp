@@ -1,14 +1,11 @@
 #pragma once
 
-#include <memory>
-#include <sstream>
-//#include "../src/cs/config.hpp"
-#include "make_unique_define.h"
+#include "error.hpp"
 
-
-/// Formatted string, allows to use stream operators and returns a std::string with the resulting format
-#define fs(x) \
-   (static_cast<const std::ostringstream&>(((*std::make_unique<std::ostringstream>().get()) << x)).str ())
+#include <cstring>
+#include <functional>
+#include <string>
+#include <uv.h>
 
 namespace uvpp {
 typedef sockaddr_in ip4_addr;
@@ -19,7 +16,7 @@ inline ip4_addr to_ip4_addr(const std::string& ip, int port)
     ip4_addr result;
     int res = 0;
     if ((res = uv_ip4_addr(ip.c_str(), port, &result)) != 0)
-        throw exception(fs("uv_ip4_addr error: " << error(res).str()));
+        throw exception(std::string("uv_ip4_addr error: ") + error(res).str());
     return result;
 }
 
@@ -28,7 +25,7 @@ inline ip6_addr to_ip6_addr(const std::string& ip, int port)
     ip6_addr result;
     int res = 0;
     if ((res = uv_ip6_addr(ip.c_str(), port, &result)) != 0)
-        throw exception(fs("uv_ip6_addr error: " << error(res).str()));
+        throw exception(std::string("uv_ip6_addr error: ") + error(res).str());
     return result;
 }
 
@@ -55,5 +52,192 @@ inline bool from_ip6_addr(ip6_addr* src, std::string& ip, int& port)
     }
     return false;
 }
+
+/**
+ * IPv4 or IPv6 address and port, parsed once and then passed around by value instead of text.
+ * Comparable and hashable so that it can key connection tables, formatted only on demand.
+ */
+class endpoint
+{
+public:
+    /// empty, family() is AF_UNSPEC
+    endpoint()
+    {
+        memset(&m_addr, 0, sizeof(m_addr));
+    }
+
+    /// copies an AF_INET or AF_INET6 address, anything else gives an empty endpoint
+    explicit endpoint(const sockaddr* addr)
+    {
+        memset(&m_addr, 0, sizeof(m_addr));
+        if (addr && addr->sa_family == AF_INET)
+            memcpy(&m_addr.in4, addr, sizeof(m_addr.in4));
+        else if (addr && addr->sa_family == AF_INET6)
+            memcpy(&m_addr.in6, addr, sizeof(m_addr.in6));
+    }
+
+    /// throws like to_ip4_addr
+    static endpoint ip4(const std::string& ip, int port)
+    {
+        ip4_addr addr = to_ip4_addr(ip, port);
+        return endpoint(reinterpret_cast<const sockaddr*>(&addr));
+    }
+
+    /// throws like to_ip6_addr
+    static endpoint ip6(const std::string& ip, int port)
+    {
+        ip6_addr addr = to_ip6_addr(ip, port);
+        return endpoint(reinterpret_cast<const sockaddr*>(&addr));
+    }
+
+    /// parses an IPv4 or IPv6 address, false if ip is neither
+    static bool parse(const std::string& ip, int port, endpoint& result)
+    {
+        ip4_addr addr4;
+        if (uv_ip4_addr(ip.c_str(), port, &addr4) == 0)
+        {
+            result = endpoint(reinterpret_cast<const sockaddr*>(&addr4));
+            return true;
+        }
+        ip6_addr addr6;
+        if (uv_ip6_addr(ip.c_str(), port, &addr6) == 0)
+        {
+            result = endpoint(reinterpret_cast<const sockaddr*>(&addr6));
+            return true;
+        }
+        return false;
+    }
+
+    int family() const
+    {
+        return m_addr.sa.sa_family;
+    }
+
+    bool empty() const
+    {
+        return family() != AF_INET && family() != AF_INET6;
+    }
+
+    bool ip4() const
+    {
+        return family() == AF_INET;
+    }
+
+    int port() const
+    {
+        return ntohs(ip4() ? m_addr.in4.sin_port : m_addr.in6.sin6_port);
+    }
+
+    const sockaddr* get() const
+    {
+        return &m_addr.sa;
+    }
+
+    /// size of the address get() points to
+    int size() const
+    {
+        return ip4() ? sizeof(m_addr.in4) : sizeof(m_addr.in6);
+    }
+
+    /// the address alone, empty if the endpoint is
+    std::string ip() const
+    {
+        char text[64] = {'\0'};
+        if (ip4())
+            uv_ip4_name(&m_addr.in4, text, sizeof(text));
+        else if (family() == AF_INET6)
+            uv_ip6_name(&m_addr.in6, text, sizeof(text));
+        return text;
+    }
+
+    /// "1.2.3.4:80" or "[::1]:80"
+    std::string to_string() const
+    {
+        if (empty())
+            return std::string();
+        const std::string port_text = ":" + std::to_string(port());
+        return ip4() ? ip() + port_text : "[" + ip() + "]" + port_text;
+    }
+
+    bool operator==(const endpoint& other) const
+    {
+        return compare(other) == 0;
+    }
+
+    bool operator!=(const endpoint& other) const
+    {
+        return compare(other) != 0;
+    }
+
+    bool operator<(const endpoint& other) const
+    {
+        return compare(other) < 0;
+    }
+
+    size_t hash() const
+    {
+        // FNV-1a over the family, port and address
+        size_t h = static_cast<size_t>(14695981039346656037ULL);
+        auto mix = [&h](const void* data, size_t len)
+        {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < len; ++i)
+                h = (h ^ bytes[i]) * static_cast<size_t>(1099511628211ULL);
+        };
+        const int f = family();
+        mix(&f, sizeof(f));
+        if (ip4())
+        {
+            mix(&m_addr.in4.sin_port, sizeof(m_addr.in4.sin_port));
+            mix(&m_addr.in4.sin_addr, sizeof(m_addr.in4.sin_addr));
+        }
+        else if (f == AF_INET6)
+        {
+            mix(&m_addr.in6.sin6_port, sizeof(m_addr.in6.sin6_port));
+            mix(&m_addr.in6.sin6_addr, sizeof(m_addr.in6.sin6_addr));
+            mix(&m_addr.in6.sin6_scope_id, sizeof(m_addr.in6.sin6_scope_id));
+        }
+        return h;
+    }
+
+private:
+    /// orders by family, then address, then port, ignoring the padding and IPv6 flow info
+    int compare(const endpoint& other) const
+    {
+        if (family() != other.family())
+            return family() < other.family() ? -1 : 1;
+        int c = 0;
+        if (ip4())
+            c = memcmp(&m_addr.in4.sin_addr, &other.m_addr.in4.sin_addr, sizeof(m_addr.in4.sin_addr));
+        else if (family() == AF_INET6)
+        {
+            c = memcmp(&m_addr.in6.sin6_addr, &other.m_addr.in6.sin6_addr, sizeof(m_addr.in6.sin6_addr));
+            if (! c && m_addr.in6.sin6_scope_id != other.m_addr.in6.sin6_scope_id)
+                c = m_addr.in6.sin6_scope_id < other.m_addr.in6.sin6_scope_id ? -1 : 1;
+        }
+        else
+            return 0;
+        if (c)
+            return c;
+        return port() == other.port() ? 0 : (port() < other.port() ? -1 : 1);
+    }
+
+    union
+    {
+        sockaddr sa;
+        sockaddr_in in4;
+        sockaddr_in6 in6;
+    } m_addr;
+};
+}
+
+namespace std {
+template<>
+struct hash<uvpp::endpoint>
+{
+    size_t operator()(const uvpp::endpoint& e) const
+    {
+        return e.hash();
+    }
+};
 }
-#undef fs
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "stream.hpp"
+#include "buffer.hpp"
+#include "loop.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace uvpp {
+/**
+ * Corked output queue of a stream: the messages pushed during a loop iteration are written at the
+ * end of it as a single uv_write with one uv_buf_t per message.
+ *
+ * size() counts the bytes queued and in flight. When it reaches the high watermark the queue is
+ * congested and on_high_watermark is called so producers can back off, on_low_watermark is called
+ * once the writes bring it back down to the low watermark.
+ *
+ * The queue may be destroyed with writes in flight, those free their messages once done without
+ * calling back; what was pushed and not flushed yet is dropped.
+ */
+template<typename HANDLE_T>
+class output_queue
+{
+public:
+    output_queue(stream<HANDLE_T>& s, size_t high_watermark = 1024 * 1024, size_t low_watermark = 256 * 1024):
+        m_stream(s)
+        , m_high_watermark(high_watermark)
+        , m_low_watermark(low_watermark)
+        , m_pending(new batch())
+        , m_size(0)
+        , m_congested(false)
+        , m_self(std::make_shared<output_queue*>(this))
+    {
+        assert(low_watermark <= high_watermark);
+        m_tick.data = this;
+        m_tick.run = [](internal::tick_node* n)
+        {
+            static_cast<output_queue*>(n->data)->flush();
+        };
+    }
+
+    ~output_queue()
+    {
+        *m_self = nullptr;
+    }
+
+    output_queue(const output_queue&) = delete;
+    output_queue& operator=(const output_queue&) = delete;
+
+    void push(std::string msg)
+    {
+        const size_t len = msg.size();
+        if (len == 0)
+            return;
+        m_pending->items.emplace_back();
+        m_pending->items.back().str = std::move(msg);
+        queued(len);
+    }
+
+    /// the buffer is shared, not copied, until written
+    void push(buffer buf)
+    {
+        const size_t len = buf.size();
+        if (len == 0)
+            return;
+        m_pending->items.emplace_back();
+        m_pending->items.back().buf = std::move(buf);
+        m_pending->items.back().is_buffer = true;
+        queued(len);
+    }
+
+    /// writes what's queued now instead of at the end of the iteration
+    void flush()
+    {
+        m_tick.unlink();
+        if (m_pending->items.empty())
+            return;
+
+        std::unique_ptr<batch> b(std::move(m_pending));
+        m_pending = take_batch();
+
+        b->bufs.clear();
+        for (const item& i : b->items)
+            b->bufs.push_back(i.is_buffer ? make_buf(i.buf) : make_buf(i.str));
+
+        batch* sent = b.release();
+        std::shared_ptr<output_queue*> self = m_self;
+        const int res = m_stream.write_bufs(sent->bufs.data(), static_cast<unsigned int>(sent->bufs.size()), [self, sent](error err)
+        {
+            if (*self)
+                (*self)->written(sent, err);
+            else
+                delete sent;
+        });
+        if (res != 0)
+            written(sent, error(res));
+    }
+
+    /// bytes queued and in flight
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool congested() const
+    {
+        return m_congested;
+    }
+
+    void set_watermarks(size_t high_watermark, size_t low_watermark)
+    {
+        assert(low_watermark <= high_watermark);
+        m_high_watermark = high_watermark;
+        m_low_watermark = low_watermark;
+    }
+
+    void on_high_watermark(Callback callback)
+    {
+        m_on_high_watermark = std::move(callback);
+    }
+
+    void on_low_watermark(Callback callback)
+    {
+        m_on_low_watermark = std::move(callback);
+    }
+
+    /// called when a write fails, the messages of that write are dropped
+    void on_error(CallbackWithResult callback)
+    {
+        m_on_error = std::move(callback);
+    }
+
+private:
+    struct item
+    {
+        item():
+            is_buffer(false)
+        {
+        }
+
+        std::string str;
+        buffer buf;
+        bool is_buffer;
+    };
+
+    struct batch
+    {
+        batch():
+            bytes(0)
+        {
+        }
+
+        std::vector<item> items;
+        std::vector<uv_buf_t> bufs;
+        size_t bytes;
+    };
+
+    void queued(size_t len)
+    {
+        m_pending->bytes += len;
+        m_size += len;
+        internal::get_tick_hooks(m_stream.template get<uv_handle_t>()->loop).schedule(&m_tick);
+        if (! m_congested && m_size >= m_high_watermark)
+        {
+            m_congested = true;
+            if (m_on_high_watermark)
+                m_on_high_watermark();
+        }
+    }
+
+    void written(batch* sent, error err)
+    {
+        m_size -= sent->bytes;
+        sent->items.clear();
+        sent->bytes = 0;
+        m_free.emplace_back(sent);
+
+        if (err && m_on_error)
+            m_on_error(err);
+        // the bytes of a failed write are dropped, which relieves the queue as well
+        if (m_congested && m_size <= m_low_watermark)
+        {
+            m_congested = false;
+            if (m_on_low_watermark)
+                m_on_low_watermark();
+        }
+    }
+
+    std::unique_ptr<batch> take_batch()
+    {
+        if (m_free.empty())
+            return std::unique_ptr<batch>(new batch());
+        std::unique_ptr<batch> b(std::move(m_free.back()));
+        m_free.pop_back();
+        return b;
+    }
+
+    stream<HANDLE_T>& m_stream;
+    size_t m_high_watermark;
+    size_t m_low_watermark;
+    std::unique_ptr<batch> m_pending;
+    /// batches done writing, kept with their capacity for reuse
+    std::vector<std::unique_ptr<batch>> m_free;
+    size_t m_size;
+    bool m_congested;
+    Callback m_on_high_watermark;
+    Callback m_on_low_watermark;
+    CallbackWithResult m_on_error;
+    /// how the writes in flight reach the queue, null once it's destroyed
+    std::shared_ptr<output_queue*> m_self;
+    internal::tick_node m_tick;
+};
+}
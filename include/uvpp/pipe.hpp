@@ -4,21 +4,38 @@
 #include "loop.hpp"
 
 namespace uvpp {
+namespace internal {
+template<>
+struct handle_traits<uv_pipe_t>
+{
+    typedef callback_slots<
+        uv_cid_close, uv_cid_listen, uv_cid_read_start, uv_cid_read_buffer,
+        uv_cid_read_prepare, uv_cid_drain, uv_cid_congested, uv_cid_shutdown,
+        uv_cid_connect> callbacks_type;
+};
+}
+
 class Pipe : public stream<uv_pipe_t>
 {
 public:
     Pipe(const bool fd_pass = false):
-        stream()
+        stream(uv_default_loop())
     {
         uv_pipe_init(uv_default_loop(), get(), fd_pass ? 1 : 0);
     }
 
     Pipe(loop& l, const bool fd_pass = false):
-        stream()
+        stream(l.get())
     {
         uv_pipe_init(l.get(), get(), fd_pass ? 1 : 0);
     }
 
+    /// wraps an existing pipe or unix socket, which the Pipe owns from then on
+    bool open(uv_file file)
+    {
+        return uv_pipe_open(get(), file) == 0;
+    }
+
     bool bind(const std::string& name)
     {
         return uv_pipe_bind(get(), name.c_str()) == 0;
@@ -26,11 +43,12 @@ public:
 
     void connect(const std::string& name, CallbackWithResult callback)
     {
-        callbacks::store(get()->data, internal::uv_cid_connect, callback);
-        uv_pipe_connect(new uv_connect_t, get(), name.c_str(), [](uv_connect_t* req, int status)
+        slots(get()->data).store<internal::uv_cid_connect>(callback);
+        uv_pipe_connect(internal::get_slab(get()->loop).create<uv_connect_t>(), get(), name.c_str(), [](uv_connect_t* req, int status)
         {
-            std::unique_ptr<uv_connect_t> reqHolder(req);
-            callbacks::invoke<decltype(callback)>(req->handle->data, internal::uv_cid_connect, error(status));
+            uv_stream_t* s = req->handle;
+            internal::get_slab(s->loop).destroy(req);
+            slots(s->data).invoke<internal::uv_cid_connect>(error(status));
         });
     }
 
@@ -79,5 +97,27 @@ public:
     {
         return uv_pipe_pending_type(get());
     }
+
+    /**
+     * Sends send_handle, a Tcp or Pipe, to the other end of an fd_pass pipe together with buf,
+     * which must not be empty. send_handle has to stay open until callback is called, after that
+     * it can be closed as the other end has its own copy.
+     */
+    template<typename SEND_T>
+    bool write2(const char* buf, int len, stream<SEND_T>& send_handle, CallbackWithResult callback)
+    {
+        uv_buf_t bufs[] = { make_buf(buf, static_cast<size_t>(len)) };
+        return write_bufs(bufs, 1, std::move(callback), send_handle.template get<uv_stream_t>()) == 0;
+    }
+
+    /**
+     * Takes the next handle received over an fd_pass pipe, when pending_count() > 0, into client
+     * whose type must match pending_type()
+     */
+    template<typename CLIENT_T>
+    bool accept_pending(stream<CLIENT_T>& client)
+    {
+        return uv_accept(get<uv_stream_t>(), client.template get<uv_stream_t>()) == 0;
+    }
 };
 }
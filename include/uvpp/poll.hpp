@@ -2,31 +2,40 @@
 
 #include "handle.hpp"
 #include "error.hpp"
+#include "loop.hpp"
 
 namespace uvpp {
 
+namespace internal {
+template<>
+struct handle_traits<uv_poll_t>
+{
+    typedef callback_slots<uv_cid_close, uv_cid_poll> callbacks_type;
+};
+}
+
 class Poll : public handle<uv_poll_t>
 {
 public:
     Poll(int fd):
-        handle<uv_poll_t>()
+        handle<uv_poll_t>(uv_default_loop())
     {
         uv_poll_init(uv_default_loop(), get(),fd);
     }
 
     Poll(loop& l, int fd):
-        handle<uv_poll_t>()
+        handle<uv_poll_t>(l.get())
     {
         uv_poll_init(l.get(), get(), fd);
     }
 
     error start( int events, std::function<void(int status,int events)> callback)
     {
-        callbacks::store(get()->data, internal::uv_cid_poll, callback);
+        slots(get()->data).store<internal::uv_cid_poll>(callback);
         return error(uv_poll_start(get(), events,
                                    [](uv_poll_t* handle, int status, int events)
         {
-            callbacks::invoke<decltype(callback)>(handle->data, internal::uv_cid_poll, status, events);
+            slots(handle->data).invoke<internal::uv_cid_poll>(status, events);
         }
                                   ));
     }
@@ -0,0 +1,437 @@
+#pragma once
+
+#include "callback.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+namespace uvpp {
+class buffer;
+
+/**
+ * Free list of objects of type T. Released objects are destroyed and their memory kept for the
+ * next acquire, memory goes back to the heap only when the pool is destroyed.
+ *
+ * Pools hang from a loop and are only used from its thread, so there's no locking.
+ */
+template<typename T>
+class object_pool
+{
+public:
+    object_pool():
+        m_free(nullptr)
+        , m_available(0)
+    {
+    }
+
+    ~object_pool()
+    {
+        while (m_free)
+        {
+            node* n = m_free;
+            m_free = n->next;
+            ::operator delete(n);
+        }
+    }
+
+    object_pool(const object_pool&) = delete;
+    object_pool& operator=(const object_pool&) = delete;
+
+    template<typename ...A>
+    T* acquire(A&& ... args)
+    {
+        void* p = m_free;
+        if (m_free)
+        {
+            m_free = m_free->next;
+            --m_available;
+        }
+        else
+        {
+            p = ::operator new(sizeof(node));
+        }
+
+        try
+        {
+            return new (p) T(std::forward<A>(args)...);
+        }
+        catch (...)
+        {
+            push(p);
+            throw;
+        }
+    }
+
+    void release(T* obj)
+    {
+        assert(obj);
+        obj->~T();
+        push(obj);
+    }
+
+    /// number of released objects ready for reuse
+    size_t available() const
+    {
+        return m_available;
+    }
+
+private:
+    union node
+    {
+        node* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    void push(void* p)
+    {
+        node* n = static_cast<node*>(p);
+        n->next = m_free;
+        m_free = n;
+        ++m_available;
+    }
+
+    node* m_free;
+    size_t m_available;
+};
+
+/**
+ * Fixed size byte buffers recycled through a free list, used for stream reads. Up to max_free
+ * released buffers are kept for reuse, the rest go back to the heap.
+ *
+ * hits counts the buffers served from the free list, misses the ones that had to be allocated.
+ */
+class buffer_pool
+{
+public:
+    explicit buffer_pool(size_t buffer_size = 65536, size_t max_free = 64):
+        m_buffer_size(buffer_size)
+        , m_max_free(max_free)
+        , m_free(nullptr)
+        , m_available(0)
+        , m_hits(0)
+        , m_misses(0)
+    {
+    }
+
+    ~buffer_pool()
+    {
+        trim(0);
+    }
+
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+
+    /// returns a buffer of buffer_size() bytes
+    char* acquire()
+    {
+        header* h = m_free;
+        if (h)
+        {
+            m_free = h->next;
+            --m_available;
+            ++m_hits;
+        }
+        else
+        {
+            h = static_cast<header*>(::operator new(sizeof(header) + m_buffer_size));
+            h->size = m_buffer_size;
+            h->pool = this;
+            ++m_misses;
+        }
+        h->refs = 1;
+        return reinterpret_cast<char*>(h + 1);
+    }
+
+    /// gives back a buffer obtained from acquire
+    void release(char* buf)
+    {
+        assert(buf);
+        header* h = header_of(buf);
+        if (h->size != m_buffer_size || m_available >= m_max_free)
+        {
+            ::operator delete(h);
+            return;
+        }
+        h->next = m_free;
+        m_free = h;
+        ++m_available;
+    }
+
+    size_t buffer_size() const
+    {
+        return m_buffer_size;
+    }
+
+    /// changes the size of the buffers handed out from now on, cached buffers are dropped
+    void set_buffer_size(size_t buffer_size)
+    {
+        trim(0);
+        m_buffer_size = buffer_size;
+    }
+
+    void set_max_free(size_t max_free)
+    {
+        m_max_free = max_free;
+        trim(max_free);
+    }
+
+    /// releases cached buffers to the heap until at most max_free are left
+    void trim(size_t max_free)
+    {
+        while (m_available > max_free)
+        {
+            header* h = m_free;
+            m_free = h->next;
+            --m_available;
+            ::operator delete(h);
+        }
+    }
+
+    size_t available() const
+    {
+        return m_available;
+    }
+
+    size_t hits() const
+    {
+        return m_hits;
+    }
+
+    size_t misses() const
+    {
+        return m_misses;
+    }
+
+private:
+    friend class buffer;
+
+    struct header
+    {
+        size_t size;
+        size_t refs;
+        header* next;
+        buffer_pool* pool;
+    };
+
+    static header* header_of(char* buf)
+    {
+        return reinterpret_cast<header*>(buf) - 1;
+    }
+
+    /// reference counting of the buffers shared through uvpp::buffer
+    static void add_ref(char* buf)
+    {
+        ++header_of(buf)->refs;
+    }
+
+    static void unref(char* buf)
+    {
+        header* h = header_of(buf);
+        assert(h->refs > 0);
+        if (--h->refs == 0)
+            h->pool->release(buf);
+    }
+
+    static size_t use_count(char* buf)
+    {
+        return header_of(buf)->refs;
+    }
+
+    size_t m_buffer_size;
+    size_t m_max_free;
+    header* m_free;
+    size_t m_available;
+    size_t m_hits;
+    size_t m_misses;
+};
+
+/**
+ * Memory for small objects of any type, such as requests and handle blocks, in cache line aligned
+ * blocks carved from large chunks. Freed blocks are kept on a free list per size class, a multiple
+ * of the cache line, for the next allocation of that class. Sizes above max_size are left to the
+ * heap, in blocks aligned the same way.
+ *
+ * Like the pools a slab hangs from a loop and is only used from its thread. Wrappers may outlive
+ * their loop though, so the loop detaches its slab rather than destroying it: the chunks go back to
+ * the heap once the loop is gone and the last block has been deallocated.
+ */
+class slab
+{
+public:
+    static const size_t alignment = 64;
+    static const size_t max_size = 4096;
+    static const size_t chunk_size = 64 * 1024;
+
+    slab():
+        m_cursor(nullptr)
+        , m_left(0)
+        , m_in_use(0)
+        , m_detached(false)
+    {
+        for (free_block*& f : m_free)
+            f = nullptr;
+    }
+
+    slab(const slab&) = delete;
+    slab& operator=(const slab&) = delete;
+
+    /// gives up the owner's reference, the slab deletes itself with its last block
+    void detach()
+    {
+        m_detached = true;
+        if (! m_in_use)
+            delete this;
+    }
+
+    void* allocate(size_t size)
+    {
+        void* p;
+        const size_t c = size_class(size);
+        if (size > max_size)
+        {
+            p = allocate_large(size);
+        }
+        else if (free_block* f = m_free[c])
+        {
+            m_free[c] = f->next;
+            p = f;
+        }
+        else
+        {
+            p = carve(c * alignment);
+        }
+        ++m_in_use;
+        return p;
+    }
+
+    /// a T constructed in a block of its size class
+    template<typename T, typename ...A>
+    T* create(A&& ... args)
+    {
+        static_assert(alignof(T) <= alignment, "over-aligned type");
+        void* p = allocate(sizeof(T));
+        try
+        {
+            return new (p) T(std::forward<A>(args)...);
+        }
+        catch (...)
+        {
+            deallocate(p, sizeof(T));
+            throw;
+        }
+    }
+
+    template<typename T>
+    void destroy(T* obj)
+    {
+        assert(obj);
+        obj->~T();
+        deallocate(obj, sizeof(T));
+    }
+
+    /// size is the one p was allocated with
+    void deallocate(void* p, size_t size)
+    {
+        assert(p && m_in_use);
+        --m_in_use;
+        if (size > max_size)
+        {
+            deallocate_large(p);
+        }
+        else
+        {
+            free_block* f = static_cast<free_block*>(p);
+            const size_t c = size_class(size);
+            f->next = m_free[c];
+            m_free[c] = f;
+        }
+        if (m_detached && ! m_in_use)
+            delete this;
+    }
+
+    /// blocks allocated and not deallocated yet
+    size_t in_use() const
+    {
+        return m_in_use;
+    }
+
+    /// bytes taken from the heap in chunks
+    size_t reserved() const
+    {
+        return m_chunks.size() * chunk_size;
+    }
+
+private:
+    ~slab()
+    {
+    }
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    static size_t size_class(size_t size)
+    {
+        return (std::max<size_t>(size, 1) + alignment - 1) / alignment;
+    }
+
+    /// the ::operator new block holding it is stored right before the aligned block
+    static void* allocate_large(size_t size)
+    {
+        // ::operator new aligns on at least twice a pointer, leaving room for it below the line
+        char* raw = static_cast<char*>(::operator new(size + alignment));
+        char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + alignment) & ~static_cast<uintptr_t>(alignment - 1));
+        reinterpret_cast<char**>(p)[-1] = raw;
+        return p;
+    }
+
+    static void deallocate_large(void* p)
+    {
+        ::operator delete(static_cast<char**>(p)[-1]);
+    }
+
+    void* carve(size_t bytes)
+    {
+        if (m_left < bytes)
+        {
+            // the extra line pays for aligning the start of the chunk
+            m_chunks.emplace_back(new char[chunk_size + alignment]);
+            const uintptr_t start = reinterpret_cast<uintptr_t>(m_chunks.back().get());
+            m_cursor = reinterpret_cast<char*>((start + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+            m_left = chunk_size;
+        }
+        void* p = m_cursor;
+        m_cursor += bytes;
+        m_left -= bytes;
+        return p;
+    }
+
+    free_block* m_free[max_size / alignment + 1];
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+    char* m_cursor;
+    size_t m_left;
+    size_t m_in_use;
+    bool m_detached;
+};
+
+namespace internal {
+/**
+ * A uv_write_t carrying the completion callback of its own write
+ */
+struct write_request
+{
+    write_request()
+    {
+        req.data = this;
+    }
+
+    uv_write_t req;
+    inline_callback<void(error)> callback;
+};
+}
+}
@@ -1,63 +1,27 @@
 #pragma once
 
-#include "callback.hpp"
+#include "handle.hpp"
 #include "error.hpp"
 
 namespace uvpp {
-namespace {
-template<typename REQUEST_T>
-inline void free_request(REQUEST_T** h)
-{
-    if (*h == nullptr)
-        return;
-
-    if ((*h)->data)
-    {
-        delete reinterpret_cast<callbacks*>((*h)->data);
-        (*h)->data = nullptr;
-    }
-
-    switch ((*h)->type)
-    {
-
-        case UV_WORK:
-            delete reinterpret_cast<uv_work_t*>(*h);
-            break;
-
-        case UV_FS:
-            delete reinterpret_cast<uv_fs_t*>(*h);
-            break;
-            
-        case UV_GETADDRINFO:
-            delete reinterpret_cast<uv_getaddrinfo_t*>(*h);
-            break;
-            
-        default:
-            assert(0);
-            throw std::runtime_error("free_request can't handle this type");
-            break;
-            *h = nullptr;
-    }
-}
-
-}
 
 /**
- * Wraps a libuv's uv_handle_t, or derived such as uv_stream_t, uv_tcp_t etc.
+ * Wraps a libuv's uv_req_t, or derived such as uv_fs_t, uv_work_t etc.
  *
- * Resources are released on the close call as mandated by libuv and NOT on the dtor
+ * The request and its callbacks are allocated as one block from the slab of the loop, and go back
+ * to it on the dtor.
  */
 template<typename REQUEST_T>
 class request
 {
 protected:
-    request():
-        m_uv_request(new REQUEST_T())
+    typedef internal::handle_block<REQUEST_T> block_type;
+    typedef typename block_type::callbacks_type callbacks_type;
+
+    explicit request(uv_loop_t* l):
+        m_uv_request(&block_type::create(l, 1)->uv)
         , m_will_close(false)
     {
-        assert(m_uv_request);
-        m_uv_request->data = new callbacks();
-        assert(m_uv_request->data);
     }
 
     request(request&& other):
@@ -72,6 +36,7 @@ protected:
     {
         if (this == &other)
             return *this;
+        reset();
         m_uv_request = other.m_uv_request;
         m_will_close = other.m_will_close;
         other.m_uv_request = nullptr;
@@ -81,13 +46,21 @@ protected:
 
     ~request()
     {
-        if (! m_will_close)
-            free_request(&m_uv_request);
+        reset();
     }
 
     request(const request&) = delete;
     request& operator=(const request&) = delete;
 
+    /**
+     * Callback slots of the request from its data member, usable from the libuv callbacks
+     */
+    static internal::dispatcher<block_type> slots(void* data)
+    {
+        assert(data);
+        return internal::dispatcher<block_type>(*static_cast<block_type*>(data));
+    }
+
 public:
     template<typename T=REQUEST_T>
     T* get()
@@ -101,6 +74,12 @@ public:
         return reinterpret_cast<const T*>(m_uv_request);
     }
 
+    /// see handle::set_tag
+    void set_tag(const char* tag)
+    {
+        static_cast<block_type*>(m_uv_request->data)->tag = tag;
+    }
+
     int cancel()
     {
         return uv_cancel((uv_req_t*)get());
@@ -109,6 +88,14 @@ public:
 protected:
     REQUEST_T* m_uv_request;
     bool m_will_close;
+
+private:
+    void reset()
+    {
+        if (m_uv_request)
+            static_cast<block_type*>(m_uv_request->data)->release();
+        m_uv_request = nullptr;
+    }
 };
 
 }
\ No newline at end of file
@@ -6,17 +6,25 @@
 
 namespace uvpp {
     
+namespace internal {
+template<>
+struct handle_traits<uv_getaddrinfo_t>
+{
+    typedef callback_slots<uv_cid_resolve> callbacks_type;
+};
+}
+
 class Resolver : public request<uv_getaddrinfo_t>
 {
 public:
     typedef std::function<void(const error&, bool, const std::string&)> Callback; // status, is_ip4, addr
-    Resolver(loop& l) : request<uv_getaddrinfo_t>(), loop_(l.get())
+    Resolver(loop& l) : request<uv_getaddrinfo_t>(l.get()), loop_(l.get())
     {
 
     }
     bool resolve(const std::string& addr, Callback callback)
     {
-        callbacks::store(get()->data, internal::uv_cid_resolve, callback);
+        slots(get()->data).store<internal::uv_cid_resolve>(callback);
         return (uv_getaddrinfo(loop_
                 , get()
                 , [](uv_getaddrinfo_t* req, int status, struct addrinfo* res)
@@ -36,15 +44,15 @@ public:
                             uv_ip4_name(reinterpret_cast<struct sockaddr_in*>(res->ai_addr), addr, res->ai_addrlen);
                         } else
                         {
-                            callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_resolve
-                                , error(EAI_ADDRFAMILY)
+                            slots(req->data).invoke<internal::uv_cid_resolve>(
+                                  error(EAI_ADDRFAMILY)
                                 , false
                                 , addr);
                             return;
                         }
                     }
                     bool ip4 = res ? res->ai_family == AF_INET : false;
-                    callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_resolve, error(status), ip4, addr);
+                    slots(req->data).invoke<internal::uv_cid_resolve>(error(status), ip4, addr);
                 }
                 , addr.c_str(), 0, 0) == 0);
     }
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <uv.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <memory>
+#include <string.h>
+
+namespace uvpp {
+/**
+ * Per connection input buffer for stream::read_start_into: reads go to the free space at the
+ * tail (prepare/commit), the protocol parses and consumes from the front (data/size/consume).
+ *
+ * Unread bytes are always contiguous so frames can be parsed in place. Space consumed at the front
+ * is reused by moving the unread bytes, usually a partial frame, back to the start once the tail
+ * runs out, and the storage only grows when the unread bytes don't leave enough room. In steady
+ * state there are neither allocations nor copies of whole frames.
+ */
+class ring_buffer
+{
+public:
+    explicit ring_buffer(size_t capacity = 65536):
+        m_storage(new char[capacity])
+        , m_capacity(capacity)
+        , m_begin(0)
+        , m_end(0)
+    {
+    }
+
+    /// the moved from buffer is left empty without storage, prepare allocates it again
+    ring_buffer(ring_buffer&& other):
+        m_storage(std::move(other.m_storage))
+        , m_capacity(other.m_capacity)
+        , m_begin(other.m_begin)
+        , m_end(other.m_end)
+    {
+        other.m_capacity = 0;
+        other.m_begin = other.m_end = 0;
+    }
+
+    ring_buffer& operator=(ring_buffer&& other)
+    {
+        if (this != &other)
+        {
+            m_storage = std::move(other.m_storage);
+            m_capacity = other.m_capacity;
+            m_begin = other.m_begin;
+            m_end = other.m_end;
+            other.m_capacity = 0;
+            other.m_begin = other.m_end = 0;
+        }
+        return *this;
+    }
+
+    ring_buffer(const ring_buffer&) = delete;
+    ring_buffer& operator=(const ring_buffer&) = delete;
+
+    /**
+     * Returns the writable space at the tail, making sure it's at least min_size bytes
+     */
+    uv_buf_t prepare(size_t min_size = 1)
+    {
+        if (m_capacity - m_end < min_size)
+        {
+            const size_t used = size();
+            if (m_capacity - used >= min_size)
+            {
+                memmove(m_storage.get(), m_storage.get() + m_begin, used);
+            }
+            else
+            {
+                const size_t capacity = std::max(m_capacity * 2, used + min_size);
+                std::unique_ptr<char[]> storage(new char[capacity]);
+                if (used)
+                    memcpy(storage.get(), m_storage.get() + m_begin, used);
+                m_storage = std::move(storage);
+                m_capacity = capacity;
+            }
+            m_begin = 0;
+            m_end = used;
+        }
+        return uv_buf_t { m_storage.get() + m_end, m_capacity - m_end };
+    }
+
+    /// n bytes were written at the start of the space returned by prepare
+    void commit(size_t n)
+    {
+        assert(n <= m_capacity - m_end);
+        m_end += n;
+    }
+
+    /// unread bytes
+    const char* data() const
+    {
+        return m_storage.get() + m_begin;
+    }
+
+    size_t size() const
+    {
+        return m_end - m_begin;
+    }
+
+    bool empty() const
+    {
+        return m_begin == m_end;
+    }
+
+    /// drops n bytes from the front
+    void consume(size_t n)
+    {
+        assert(n <= size());
+        m_begin += n;
+        if (m_begin == m_end)
+            m_begin = m_end = 0;
+    }
+
+    void clear()
+    {
+        m_begin = m_end = 0;
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    std::unique_ptr<char[]> m_storage;
+    size_t m_capacity;
+    size_t m_begin;
+    size_t m_end;
+};
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "tcp.hpp"
+#include "async.hpp"
+#include "loop.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace uvpp {
+/**
+ * Tcp server spread over several threads, each running its own loop with its own listener bound
+ * to the same address with SO_REUSEPORT. The kernel balances the incoming connections among the
+ * listeners and a connection stays on the loop that accepted it, so loops share nothing.
+ *
+ * The connection callback runs on the thread of the loop that got the connection, which accepts
+ * it into a Tcp of that same loop. stop() can be called from any thread: each loop closes its
+ * listener and calls the stop callback, which must close the connections of that loop, and its
+ * thread finishes once the loop has no handles left.
+ */
+class sharded_server
+{
+public:
+    typedef std::function<void(size_t index, loop& l, Tcp& listener, error err)> connection_callback;
+    typedef std::function<void(size_t index, loop& l)> stop_callback;
+
+    /// loops defaults to the number of hardware threads
+    explicit sharded_server(size_t loops = 0):
+        m_workers(loops ? loops : std::max(1u, std::thread::hardware_concurrency()))
+        , m_port(0)
+    {
+    }
+
+    ~sharded_server()
+    {
+        stop();
+        join();
+    }
+
+    sharded_server(const sharded_server&) = delete;
+    sharded_server& operator=(const sharded_server&) = delete;
+
+    /// set before start, called on each loop's thread when stopping
+    void on_stop(stop_callback callback)
+    {
+        m_on_stop = std::move(callback);
+    }
+
+    /**
+     * Starts the loops one after the other, returning once all of them are listening or one
+     * failed, in which case the ones already started are stopped. With port 0 the first listener
+     * picks a port that the others then bind, see port().
+     */
+    error start(const std::string& ip, int port, connection_callback callback, int backlog = 128)
+    {
+        assert(callback);
+        m_on_connection = std::move(callback);
+        m_port = port;
+        for (size_t i = 0; i < m_workers.size(); ++i)
+        {
+            std::promise<int> ready;
+            std::future<int> result = ready.get_future();
+            m_workers[i].thread = std::thread(&sharded_server::run, this, i, ip, backlog, std::ref(ready));
+            const int res = result.get();
+            if (res != 0)
+            {
+                stop();
+                join();
+                return error(res);
+            }
+        }
+        return error(0);
+    }
+
+    /// asks every loop to stop, thread safe
+    void stop()
+    {
+        for (worker& w : m_workers)
+        {
+            std::lock_guard<std::mutex> l(w.lock);
+            if (w.stopper)
+                w.stopper->send();
+        }
+    }
+
+    /// waits for the threads of the loops to finish
+    void join()
+    {
+        for (worker& w : m_workers)
+        {
+            if (w.thread.joinable())
+                w.thread.join();
+        }
+    }
+
+    size_t size() const
+    {
+        return m_workers.size();
+    }
+
+    /// port the listeners are bound to, valid after start
+    int port() const
+    {
+        return m_port;
+    }
+
+private:
+    struct worker
+    {
+        worker():
+            stopper(nullptr)
+        {
+        }
+
+        std::thread thread;
+        std::mutex lock;
+        /// Async of the running loop, null once it's stopping
+        Async* stopper;
+    };
+
+    void run(size_t index, std::string ip, int backlog, std::promise<int>& ready)
+    {
+        worker& w = m_workers[index];
+        const bool ip6 = ip.find(':') != std::string::npos;
+        loop l;
+        Tcp listener(l, ip6 ? AF_INET6 : AF_INET);
+        Async stopper(l, [&]()
+        {
+            {
+                std::lock_guard<std::mutex> lock(w.lock);
+                w.stopper = nullptr;
+            }
+            listener.close();
+            stopper.close();
+            if (m_on_stop)
+                m_on_stop(index, l);
+        });
+
+        int res = bind(listener, ip, ip6);
+        if (res == 0)
+        {
+            res = listener.listen_status([this, index, &l, &listener](error err)
+            {
+                m_on_connection(index, l, listener, err);
+            }, backlog);
+        }
+        if (res != 0)
+        {
+            listener.close();
+            stopper.close();
+            l.run();
+            ready.set_value(res);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(w.lock);
+            w.stopper = &stopper;
+        }
+        ready.set_value(0);
+        l.run();
+    }
+
+    /// binds the listener, setting m_port if it was 0; returns a libuv error code
+    int bind(Tcp& listener, const std::string& ip, bool ip6)
+    {
+        if (m_workers.size() > 1 && ! listener.reuseport(true))
+            return UV_ENOTSUP;
+
+        sockaddr_storage addr;
+        int res = ip6
+                  ? uv_ip6_addr(ip.c_str(), m_port, reinterpret_cast<sockaddr_in6*>(&addr))
+                  : uv_ip4_addr(ip.c_str(), m_port, reinterpret_cast<sockaddr_in*>(&addr));
+        if (res == 0)
+            res = uv_tcp_bind(listener.get(), reinterpret_cast<sockaddr*>(&addr), 0);
+        if (res != 0 || m_port != 0)
+            return res;
+
+        int len = sizeof(addr);
+        res = uv_tcp_getsockname(listener.get(), reinterpret_cast<sockaddr*>(&addr), &len);
+        if (res == 0)
+            m_port = ntohs(ip6 ? reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port : reinterpret_cast<sockaddr_in*>(&addr)->sin_port);
+        return res;
+    }
+
+    std::vector<worker> m_workers;
+    int m_port;
+    connection_callback m_on_connection;
+    stop_callback m_on_stop;
+};
+}
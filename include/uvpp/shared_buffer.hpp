@@ -0,0 +1,157 @@
+#pragma once
+
+#include <uv.h>
+
+#include <assert.h>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+
+namespace uvpp {
+/**
+ * Immutable, reference counted bytes, for a payload written to many streams: each write holds a
+ * copy, which costs a reference rather than a copy of the bytes, and the memory is freed once the
+ * last write completed and the last copy is gone. The count and the bytes are a single allocation.
+ *
+ * Unlike buffer it isn't tied to a loop, the bytes never change once built and copies can be
+ * released from any thread, so a message can be built on a worker and fanned out by the loops.
+ */
+class shared_buffer
+{
+public:
+    shared_buffer():
+        m_block(nullptr)
+    {
+    }
+
+    /// copies the len bytes of data
+    shared_buffer(const char* data, size_t len):
+        m_block(allocate(len))
+    {
+        if (len)
+            memcpy(bytes(), data, len);
+    }
+
+    explicit shared_buffer(const std::string& s):
+        shared_buffer(s.data(), s.size())
+    {
+    }
+
+    /// nothrow, so that write callbacks holding a copy are stored inline in their request
+    shared_buffer(const shared_buffer& other) noexcept:
+        m_block(other.m_block)
+    {
+        if (m_block)
+            m_block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    shared_buffer(shared_buffer&& other) noexcept:
+        m_block(other.m_block)
+    {
+        other.m_block = nullptr;
+    }
+
+    shared_buffer& operator=(shared_buffer other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    ~shared_buffer()
+    {
+        reset();
+    }
+
+    /**
+     * A buffer of len bytes written in place by fill(char* data, size_t len), saving the copy of a
+     * message serialized elsewhere first
+     */
+    template<typename F>
+    static shared_buffer build(size_t len, F&& fill)
+    {
+        shared_buffer result;
+        result.m_block = allocate(len);
+        fill(result.bytes(), len);
+        return result;
+    }
+
+    const char* data() const
+    {
+        return m_block ? const_cast<shared_buffer*>(this)->bytes() : nullptr;
+    }
+
+    size_t size() const
+    {
+        return m_block ? m_block->size : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    const char* begin() const
+    {
+        return data();
+    }
+
+    const char* end() const
+    {
+        return data() + size();
+    }
+
+    /// for uv_write, which doesn't write through it
+    uv_buf_t buf() const
+    {
+        return uv_buf_init(const_cast<char*>(data()), static_cast<unsigned int>(size()));
+    }
+
+    /// copies sharing the bytes, writes in flight included
+    size_t use_count() const
+    {
+        return m_block ? m_block->refs.load(std::memory_order_relaxed) : 0;
+    }
+
+    void reset()
+    {
+        if (m_block && m_block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            m_block->~header();
+            ::operator delete(m_block);
+        }
+        m_block = nullptr;
+    }
+
+    void swap(shared_buffer& other)
+    {
+        std::swap(m_block, other.m_block);
+    }
+
+private:
+    struct header
+    {
+        explicit header(size_t len):
+            refs(1)
+            , size(len)
+        {
+        }
+
+        std::atomic<size_t> refs;
+        size_t size;
+    };
+
+    static header* allocate(size_t len)
+    {
+        return new (::operator new(sizeof(header) + len)) header(len);
+    }
+
+    char* bytes()
+    {
+        return reinterpret_cast<char*>(m_block + 1);
+    }
+
+    header* m_block;
+};
+}
@@ -2,9 +2,18 @@
 
 #include "handle.hpp"
 #include "error.hpp"
+#include "loop.hpp"
 
 namespace uvpp {
 
+namespace internal {
+template<>
+struct handle_traits<uv_signal_t>
+{
+    typedef callback_slots<uv_cid_close, uv_cid_signal> callbacks_type;
+};
+}
+
 class Signal : public handle<uv_signal_t>
 {
 public:
@@ -12,13 +21,13 @@ public:
     typedef std::function<void(int sugnum)> SignalHandler;
     
     Signal():
-        handle<uv_signal_t>()
+        handle<uv_signal_t>(uv_default_loop())
     {
         uv_signal_init(uv_default_loop(), get());
     }
 
     Signal(loop& l):
-        handle<uv_signal_t>()
+        handle<uv_signal_t>(l.get())
     {
         uv_signal_init(l.get(), get());
     }
@@ -26,11 +35,11 @@ public:
 
     error start(int signum, SignalHandler callback)
     {
-        callbacks::store(get()->data, internal::uv_cid_signal, callback);
+        slots(get()->data).store<internal::uv_cid_signal>(callback);
         return error(uv_signal_start(get(),
                                      [](uv_signal_t* handle, int signum)
         {
-            callbacks::invoke<decltype(callback)>(handle->data, internal::uv_cid_signal, signum);
+            slots(handle->data).invoke<internal::uv_cid_signal>(signum);
         },
         signum));
     }
@@ -1,27 +1,143 @@
 #pragma once
 
 #include "handle.hpp"
+#include "buffer.hpp"
+#include "shared_buffer.hpp"
 #include "error.hpp"
+#include "loop.hpp"
 #include <algorithm>
+#include <initializer_list>
+#include <iterator>
 #include <memory>
+#include <vector>
 
 namespace uvpp {
+/**
+ * uv_buf_t viewing len bytes at data, the memory is not owned
+ */
+inline uv_buf_t make_buf(const char* data, size_t len)
+{
+    return uv_buf_t { const_cast<char*>(data), len };
+}
+
+inline uv_buf_t make_buf(const uv_buf_t& buf)
+{
+    return buf;
+}
+
+/**
+ * uv_buf_t viewing a contiguous container of bytes such as std::string, std::vector<char> or
+ * std::array<char, N>
+ */
+template<typename T>
+inline uv_buf_t make_buf(const T& bytes)
+{
+    return make_buf(reinterpret_cast<const char*>(bytes.data()), bytes.size() * sizeof(*bytes.data()));
+}
+
+/**
+ * Read allocator taking the buffers from the read_buffers pool of the handle's loop
+ */
+struct pool_read_allocator
+{
+    static void allocate(uv_handle_t* h, size_t, uv_buf_t* buf)
+    {
+        buffer_pool& pool = internal::get_loop_data(h->loop).read_buffers;
+        buf->base = pool.acquire();
+        buf->len = pool.buffer_size();
+    }
+
+    static void deallocate(uv_handle_t* h, const uv_buf_t* buf)
+    {
+        if (buf->base)
+            internal::get_loop_data(h->loop).read_buffers.release(buf->base);
+    }
+};
+
+/**
+ * Read allocator doing a heap allocation of at least min_size bytes per read
+ */
+template<size_t min_size>
+struct heap_read_allocator
+{
+    static void allocate(uv_handle_t*, size_t suggested_size, uv_buf_t* buf)
+    {
+        auto size = std::max(suggested_size, min_size);
+        buf->base = new char[size];
+        buf->len = size;
+    }
+
+    static void deallocate(uv_handle_t*, const uv_buf_t* buf)
+    {
+        delete[] buf->base;
+    }
+};
+
+namespace internal {
+/**
+ * Write queue watermarks of a stream, see stream::set_write_watermarks
+ */
+struct stream_state
+{
+    stream_state():
+        high_watermark(0)
+        , low_watermark(0)
+        , congested(false)
+    {
+    }
+
+    size_t high_watermark;
+    size_t low_watermark;
+    bool congested;
+};
+
+template<>
+struct handle_state<uv_tcp_t>
+{
+    typedef stream_state type;
+};
+
+template<>
+struct handle_state<uv_pipe_t>
+{
+    typedef stream_state type;
+};
+
+template<>
+struct handle_state<uv_tty_t>
+{
+    typedef stream_state type;
+};
+}
+
+template<typename HANDLE_T>
+class output_queue;
+
 template<typename HANDLE_T>
 class stream : public handle<HANDLE_T>
 {
 protected:
-    stream():
-        handle<HANDLE_T>()
+    typedef typename handle<HANDLE_T>::callbacks_type callbacks_type;
+    typedef typename handle<HANDLE_T>::state_type state_type;
+
+    explicit stream(uv_loop_t* l):
+        handle<HANDLE_T>(l)
     {}
 
 public:
     bool listen(CallbackWithResult callback, int backlog=128)
     {
-        callbacks::store(handle<HANDLE_T>::get()->data, uvpp::internal::uv_cid_listen, callback);
+        return listen_status(std::move(callback), backlog) == 0;
+    }
+
+    /// listen returning the status of uv_listen, where a bind to an address in use fails
+    int listen_status(CallbackWithResult callback, int backlog=128)
+    {
+        handle<HANDLE_T>::slots(handle<HANDLE_T>::get()->data).template store<uvpp::internal::uv_cid_listen>(callback);
         return uv_listen(handle<HANDLE_T>::template get<uv_stream_t>(), backlog, [](uv_stream_t* s, int status)
         {
-            callbacks::invoke<decltype(callback)>(s->data, uvpp::internal::uv_cid_listen, error(status));
-        }) == 0;
+            handle<HANDLE_T>::slots(s->data).template invoke<uvpp::internal::uv_cid_listen>(error(status));
+        });
     }
 
     bool accept(stream& client)
@@ -29,39 +145,130 @@ public:
         return uv_accept(handle<HANDLE_T>::template get<uv_stream_t>(), client.handle<HANDLE_T>::template get<uv_stream_t>()) == 0;
     }
 
+    /**
+     * Reads into buffers from the loop's read_buffers pool, buf is given back to the pool once
+     * callback returns. len is negative on error or EOF.
+     */
     bool read_start(std::function<void(const char* buf, ssize_t len)> callback)
     {
-        return read_start<0>(callback);
+        return read_start<pool_read_allocator>(std::move(callback));
     }
 
+    /**
+     * Reads into heap buffers of at least max_alloc_size bytes, allocated for every read
+     */
     template<size_t max_alloc_size>
     bool read_start(std::function<void(const char* buf, ssize_t len)> callback)
     {
-        callbacks::store(handle<HANDLE_T>::get()->data, uvpp::internal::uv_cid_read_start, callback);
+        return read_start<heap_read_allocator<max_alloc_size>>(std::move(callback));
+    }
+
+    /**
+     * Reads into buffers obtained from allocator_t, which provides
+     *
+     *   static void allocate(uv_handle_t* h, size_t suggested_size, uv_buf_t* buf);
+     *   static void deallocate(uv_handle_t* h, const uv_buf_t* buf);
+     *
+     * deallocate is called once callback returns, also for the buffers of failed reads.
+     */
+    template<typename allocator_t>
+    bool read_start(std::function<void(const char* buf, ssize_t len)> callback)
+    {
+        return read_start_status<allocator_t>(std::move(callback)) == 0;
+    }
+
+    /// read_start returning the status of uv_read_start
+    template<typename allocator_t = pool_read_allocator>
+    int read_start_status(std::function<void(const char* buf, ssize_t len)> callback)
+    {
+        handle<HANDLE_T>::slots(handle<HANDLE_T>::get()->data).template store<uvpp::internal::uv_cid_read_start>(std::move(callback));
 
         return uv_read_start(handle<HANDLE_T>::template get<uv_stream_t>(),
-                             [](uv_handle_t*, size_t suggested_size, uv_buf_t* buf)
+                             [](uv_handle_t* h, size_t suggested_size, uv_buf_t* buf)
         {
             assert(buf);
-            auto size = std::max(suggested_size, max_alloc_size);
-            buf->base = new char[size];
-            buf->len = size;
+            allocator_t::allocate(h, suggested_size, buf);
         },
         [](uv_stream_t* s, ssize_t nread, const uv_buf_t* buf)
         {
-            // handle callback throwing exception: hold data in unique_ptr
-            std::shared_ptr<char> baseHolder(buf->base, std::default_delete<char[]>());
+            // handle callback throwing exception: give the buffer back from a destructor
+            struct buffer_holder
+            {
+                uv_handle_t* h;
+                const uv_buf_t* buf;
+
+                ~buffer_holder()
+                {
+                    allocator_t::deallocate(h, buf);
+                }
+            } baseHolder = { reinterpret_cast<uv_handle_t*>(s), buf };
 
             if (nread < 0)
             {
                 // FIXME error has nread set to -errno, handle failure
                 // assert(nread == UV_EOF); ???
-                callbacks::invoke<decltype(callback)>(s->data, uvpp::internal::uv_cid_read_start, nullptr, nread);
+                handle<HANDLE_T>::slots(s->data).template invoke<uvpp::internal::uv_cid_read_start>(nullptr, nread);
             }
             else if (nread >= 0)
             {
-                callbacks::invoke<decltype(callback)>(s->data, uvpp::internal::uv_cid_read_start, buf->base, nread);
+                handle<HANDLE_T>::slots(s->data).template invoke<uvpp::internal::uv_cid_read_start>(buf->base, nread);
+            }
+        });
+    }
+
+    /**
+     * Zero copy reads: callback gets the pooled buffer holding the len bytes read and may keep it,
+     * or slices of it, after returning. The memory goes back to the loop's read_buffers pool once
+     * the last buffer sharing it is released. On error or EOF buf is empty and len negative, a read
+     * of nothing isn't reported.
+     */
+    bool read_start_buffers(std::function<void(buffer buf, ssize_t len)> callback)
+    {
+        handle<HANDLE_T>::slots(handle<HANDLE_T>::get()->data).template store<uvpp::internal::uv_cid_read_buffer>(std::move(callback));
+
+        return uv_read_start(handle<HANDLE_T>::template get<uv_stream_t>(),
+                             [](uv_handle_t* h, size_t suggested_size, uv_buf_t* buf)
+        {
+            assert(buf);
+            pool_read_allocator::allocate(h, suggested_size, buf);
+        },
+        [](uv_stream_t* s, ssize_t nread, const uv_buf_t* buf)
+        {
+            if (nread <= 0)
+            {
+                pool_read_allocator::deallocate(reinterpret_cast<uv_handle_t*>(s), buf);
+                // 0 is EAGAIN, nothing to hand out
+                if (nread < 0)
+                    handle<HANDLE_T>::slots(s->data).template invoke<uvpp::internal::uv_cid_read_buffer>(buffer(), nread);
             }
+            else
+            {
+                handle<HANDLE_T>::slots(s->data).template invoke<uvpp::internal::uv_cid_read_buffer>(buffer::adopt(buf->base, static_cast<size_t>(nread)), nread);
+            }
+        }) == 0;
+    }
+
+    /**
+     * Reads into memory supplied by the caller, such as the tail of a ring_buffer: before each
+     * read prepare returns the writable space to read into (suggested_size is libuv's hint), then
+     * callback gets the start of that space and the number of bytes committed to it. len is
+     * negative on error or EOF, when buf is nullptr.
+     */
+    bool read_start_into(std::function<uv_buf_t(size_t suggested_size)> prepare, std::function<void(const char* buf, ssize_t len)> callback)
+    {
+        auto slots = handle<HANDLE_T>::slots(handle<HANDLE_T>::get()->data);
+        slots.template store<uvpp::internal::uv_cid_read_prepare>(std::move(prepare));
+        slots.template store<uvpp::internal::uv_cid_read_start>(std::move(callback));
+
+        return uv_read_start(handle<HANDLE_T>::template get<uv_stream_t>(),
+                             [](uv_handle_t* h, size_t suggested_size, uv_buf_t* buf)
+        {
+            assert(buf);
+            *buf = handle<HANDLE_T>::slots(h->data).template invoke<uvpp::internal::uv_cid_read_prepare>(suggested_size);
+        },
+        [](uv_stream_t* s, ssize_t nread, const uv_buf_t* buf)
+        {
+            handle<HANDLE_T>::slots(s->data).template invoke<uvpp::internal::uv_cid_read_start>(nread < 0 ? nullptr : buf->base, nread);
         }) == 0;
     }
 
@@ -70,47 +277,185 @@ public:
         return uv_read_stop(handle<HANDLE_T>::template get<uv_stream_t>()) == 0;
     }
 
+    /**
+     * Each write carries its own callback, writes can be issued back to back without waiting for
+     * the previous ones to complete. buf must stay valid until the callback is called.
+     */
     bool write(const char* buf, int len, CallbackWithResult callback)
     {
         uv_buf_t bufs[] = { uv_buf_t { const_cast<char*>(buf), static_cast<size_t>(len) } };
-        callbacks::store(handle<HANDLE_T>::get()->data, uvpp::internal::uv_cid_write, callback);
-        return uv_write(new uv_write_t, handle<HANDLE_T>::template get<uv_stream_t>(), bufs, 1, [](uv_write_t* req, int status)
-        {
-            std::unique_ptr<uv_write_t> reqHolder(req);
-            callbacks::invoke<decltype(callback)>(req->handle->data, uvpp::internal::uv_cid_write, error(status));
-        }) == 0;
+        return write_bufs(bufs, 1, std::move(callback)) == 0;
     }
 
     bool write(const std::string& buf, CallbackWithResult callback)
     {
         uv_buf_t bufs[] = { uv_buf_t { const_cast<char*>(buf.c_str()), buf.length()} };
-        callbacks::store(handle<HANDLE_T>::get()->data, uvpp::internal::uv_cid_write, callback);
-        return uv_write(new uv_write_t, handle<HANDLE_T>::template get<uv_stream_t>(), bufs, 1, [](uv_write_t* req, int status)
-        {
-            std::unique_ptr<uv_write_t> reqHolder(req);
-            callbacks::invoke<decltype(callback)>(req->handle->data, uvpp::internal::uv_cid_write, error(status));
-        }) == 0;
+        return write_bufs(bufs, 1, std::move(callback)) == 0;
     }
 
     bool write(const std::vector<char>& buf, CallbackWithResult callback)
     {
         uv_buf_t bufs[] = { uv_buf_t { const_cast<char*>(&buf[0]), buf.size() } };
-        callbacks::store(handle<HANDLE_T>::get()->data, uvpp::internal::uv_cid_write, callback);
-        return uv_write(new uv_write_t, handle<HANDLE_T>::template get<uv_stream_t>(), bufs, 1, [](uv_write_t* req, int status)
+        return write_bufs(bufs, 1, std::move(callback)) == 0;
+    }
+
+    /// the write holds a reference to buf, which needn't be kept by the caller, see fanout
+    bool write(const shared_buffer& buf, CallbackWithResult callback)
+    {
+        uv_buf_t bufs[] = { buf.buf() };
+        return write_bufs(bufs, 1, [buf, callback](error err) { callback(err); }) == 0;
+    }
+
+    /**
+     * Scatter/gather write: all bufs are written in order with a single uv_write and one callback.
+     * The bufs array is copied, the memory it points to must stay valid until the callback is called.
+     */
+    bool writev(const uv_buf_t* bufs, size_t nbufs, CallbackWithResult callback)
+    {
+        return write_bufs(bufs, static_cast<unsigned int>(nbufs), std::move(callback)) == 0;
+    }
+
+    bool writev(std::initializer_list<uv_buf_t> bufs, CallbackWithResult callback)
+    {
+        return write_bufs(bufs.begin(), static_cast<unsigned int>(bufs.size()), std::move(callback)) == 0;
+    }
+
+    /**
+     * writev of a range of uv_buf_t or contiguous byte containers, as accepted by make_buf
+     */
+    template<typename range_t>
+    bool writev(const range_t& range, CallbackWithResult callback)
+    {
+        const size_t small = 16;
+        const size_t nbufs = static_cast<size_t>(std::distance(std::begin(range), std::end(range)));
+        uv_buf_t small_bufs[small];
+        std::vector<uv_buf_t> large_bufs;
+        uv_buf_t* bufs = small_bufs;
+        if (nbufs > small)
         {
-            std::unique_ptr<uv_write_t> reqHolder(req);
-            callbacks::invoke<decltype(callback)>(req->handle->data, uvpp::internal::uv_cid_write, error(status));
-        }) == 0;
+            large_bufs.resize(nbufs);
+            bufs = large_bufs.data();
+        }
+
+        size_t i = 0;
+        for (const auto& b : range)
+            bufs[i++] = make_buf(b);
+        return write_bufs(bufs, static_cast<unsigned int>(nbufs), std::move(callback)) == 0;
+    }
+
+    /**
+     * Bytes of the writes in flight not yet handed to the kernel, which build up when the peer
+     * reads slower than we write
+     */
+    size_t write_queue_size() const
+    {
+        return uv_stream_get_write_queue_size(handle<HANDLE_T>::template get<uv_stream_t>());
+    }
+
+    /**
+     * Once a write brings write_queue_size() to high_watermark or above the stream is congested
+     * and the on_congested callback is called. When write completions bring it back down to
+     * low_watermark on_drain is called. A high_watermark of 0, the default, disables the tracking.
+     */
+    void set_write_watermarks(size_t high_watermark, size_t low_watermark)
+    {
+        assert(low_watermark <= high_watermark);
+        state_type& st = handle<HANDLE_T>::state(handle<HANDLE_T>::get()->data);
+        st.high_watermark = high_watermark;
+        st.low_watermark = low_watermark;
+        if (high_watermark == 0)
+            st.congested = false;
+    }
+
+    bool congested() const
+    {
+        return handle<HANDLE_T>::state(handle<HANDLE_T>::get()->data).congested;
+    }
+
+    void on_congested(Callback callback)
+    {
+        handle<HANDLE_T>::slots(handle<HANDLE_T>::get()->data).template store<uvpp::internal::uv_cid_congested>(std::move(callback));
+    }
+
+    void on_drain(Callback callback)
+    {
+        handle<HANDLE_T>::slots(handle<HANDLE_T>::get()->data).template store<uvpp::internal::uv_cid_drain>(std::move(callback));
     }
 
     bool shutdown(CallbackWithResult callback)
     {
-        callbacks::store(handle<HANDLE_T>::get()->data, uvpp::internal::uv_cid_shutdown, callback);
-        return uv_shutdown(new uv_shutdown_t, handle<HANDLE_T>::template get<uv_stream_t>(), [](uv_shutdown_t* req, int status)
+        handle<HANDLE_T>::slots(handle<HANDLE_T>::get()->data).template store<uvpp::internal::uv_cid_shutdown>(callback);
+        uv_stream_t* s = handle<HANDLE_T>::template get<uv_stream_t>();
+        slab& requests = internal::get_slab(s->loop);
+        uv_shutdown_t* req = requests.create<uv_shutdown_t>();
+        if (uv_shutdown(req, s, [](uv_shutdown_t* req, int status)
+            {
+                uv_stream_t* s = req->handle;
+                internal::get_slab(s->loop).destroy(req);
+                handle<HANDLE_T>::slots(s->data).template invoke<uvpp::internal::uv_cid_shutdown>(error(status));
+            }) != 0)
         {
-            std::unique_ptr<uv_shutdown_t> reqHolder(req);
-            callbacks::invoke<decltype(callback)>(req->handle->data, uvpp::internal::uv_cid_shutdown, error(status));
-        }) == 0;
+            requests.destroy(req);
+            return false;
+        }
+        return true;
+    }
+
+protected:
+    /// writes through write_bufs to get the status of a write which failed to start
+    friend class output_queue<HANDLE_T>;
+
+    /**
+     * Writes bufs with a write request taken from the loop's slab, along with send_handle when
+     * given, see Pipe::write2. Returns the status of uv_write, callback is only called when it's 0.
+     */
+    template<typename callback_t>
+    int write_bufs(const uv_buf_t* bufs, unsigned int nbufs, callback_t&& callback, uv_stream_t* send_handle = nullptr)
+    {
+        uv_stream_t* s = handle<HANDLE_T>::template get<uv_stream_t>();
+        slab& requests = internal::get_slab(s->loop);
+        internal::write_request* req = requests.create<internal::write_request>();
+        req->callback.assign(std::forward<callback_t>(callback));
+        const int res = send_handle
+                        ? uv_write2(&req->req, s, bufs, nbufs, send_handle, &stream::on_write)
+                        : uv_write(&req->req, s, bufs, nbufs, &stream::on_write);
+        if (res != 0)
+        {
+            requests.destroy(req);
+            return res;
+        }
+
+        state_type& st = handle<HANDLE_T>::state(s->data);
+        if (st.high_watermark && ! st.congested && s->write_queue_size >= st.high_watermark)
+        {
+            st.congested = true;
+            auto slots = handle<HANDLE_T>::slots(s->data);
+            auto& on_congested = slots.template get<uvpp::internal::uv_cid_congested>();
+            if (on_congested)
+                slots.template call<uvpp::internal::uv_cid_congested>(on_congested);
+        }
+        return 0;
+    }
+
+private:
+    static void on_write(uv_write_t* r, int status)
+    {
+        internal::write_request* req = static_cast<internal::write_request*>(r->data);
+        // released before calling back so that the callback can reuse it for the next write
+        internal::inline_callback<void(error)> callback(std::move(req->callback));
+        uv_stream_t* s = r->handle;
+        internal::get_slab(s->loop).destroy(req);
+        auto slots = handle<HANDLE_T>::slots(s->data);
+        slots.template call<uvpp::internal::uv_cid_write>(callback, error(status));
+
+        state_type& st = handle<HANDLE_T>::state(s->data);
+        if (st.congested && s->write_queue_size <= st.low_watermark)
+        {
+            st.congested = false;
+            auto& on_drain = slots.template get<uvpp::internal::uv_cid_drain>();
+            if (on_drain)
+                slots.template call<uvpp::internal::uv_cid_drain>(on_drain);
+        }
     }
 };
 }
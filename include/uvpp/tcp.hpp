@@ -5,21 +5,67 @@
 #include "loop.hpp"
 
 namespace uvpp {
+namespace internal {
+template<>
+struct handle_traits<uv_tcp_t>
+{
+    typedef callback_slots<
+        uv_cid_close, uv_cid_listen, uv_cid_read_start, uv_cid_read_buffer,
+        uv_cid_read_prepare, uv_cid_drain, uv_cid_congested, uv_cid_shutdown,
+        uv_cid_connect, uv_cid_connect6> callbacks_type;
+};
+}
+
 class Tcp : public stream<uv_tcp_t>
 {
 public:
     Tcp():
-        stream()
+        stream(uv_default_loop())
     {
         uv_tcp_init(uv_default_loop(), get());
     }
 
     Tcp(loop& l):
-        stream()
+        stream(l.get())
     {
         uv_tcp_init(l.get(), get());
     }
 
+    /**
+     * Creates the socket right away with the given address family, AF_INET or AF_INET6, so that
+     * socket options like reuseport can be set before bind
+     */
+    Tcp(loop& l, unsigned int family):
+        stream(l.get())
+    {
+        uv_tcp_init_ex(l.get(), get(), family);
+    }
+
+    /// wraps an existing socket, which the Tcp owns from then on
+    bool open(uv_os_sock_t sock)
+    {
+        return uv_tcp_open(get(), sock) == 0;
+    }
+
+    /**
+     * Sets SO_REUSEPORT so that several listeners, typically one per loop, can bind the same
+     * address with the kernel spreading the incoming connections among them. The socket must
+     * exist already, see the Tcp(loop&, family) constructor. Returns false where unsupported.
+     */
+    bool reuseport(bool enable)
+    {
+#if defined(SO_REUSEPORT) && !defined(_WIN32)
+        uv_os_fd_t fd;
+        if (uv_fileno(get<uv_handle_t>(), &fd) != 0)
+            return false;
+        int value = enable ? 1 : 0;
+        return setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value)) == 0;
+#else
+        (void)enable;
+        return false;
+#endif
+    }
+
     bool nodelay(bool enable)
     {
         return uv_tcp_nodelay(get(), enable ? 1 : 0) == 0;
@@ -48,28 +94,58 @@ public:
         return uv_tcp_bind(get(), reinterpret_cast<sockaddr*>(&addr), 0) == 0;
     }
 
+    bool bind(const endpoint& ep)
+    {
+        return uv_tcp_bind(get(), ep.get(), 0) == 0;
+    }
+
     bool connect(const std::string& ip, int port, CallbackWithResult callback)
     {
-        callbacks::store(get()->data, internal::uv_cid_connect, callback);
+        slots(get()->data).store<internal::uv_cid_connect>(callback);
         ip4_addr addr = to_ip4_addr(ip, port);
-        return uv_tcp_connect(new uv_connect_t, get(), reinterpret_cast<const sockaddr*>(&addr), [](uv_connect_t* req, int status)
+        return connect_to(reinterpret_cast<const sockaddr*>(&addr), [](uv_connect_t* req, int status)
         {
-            std::unique_ptr<uv_connect_t> reqHolder(req);
-            callbacks::invoke<decltype(callback)>(req->handle->data, internal::uv_cid_connect, error(status));
+            uv_stream_t* s = req->handle;
+            internal::get_slab(s->loop).destroy(req);
+            slots(s->data).invoke<internal::uv_cid_connect>(error(status));
         }) == 0;
     }
 
     bool connect6(const std::string& ip, int port, CallbackWithResult callback)
     {
-        callbacks::store(get()->data, internal::uv_cid_connect6, callback);
+        slots(get()->data).store<internal::uv_cid_connect6>(callback);
         ip6_addr addr = to_ip6_addr(ip, port);
-        return uv_tcp_connect(new uv_connect_t, get(), reinterpret_cast<const sockaddr*>(&addr), [](uv_connect_t* req, int status)
+        return connect_to(reinterpret_cast<const sockaddr*>(&addr), [](uv_connect_t* req, int status)
         {
-            std::unique_ptr<uv_connect_t> reqHolder(req);
-            callbacks::invoke<decltype(callback)>(req->handle->data, internal::uv_cid_connect6, error(status));
+            uv_stream_t* s = req->handle;
+            internal::get_slab(s->loop).destroy(req);
+            slots(s->data).invoke<internal::uv_cid_connect6>(error(status));
         }) == 0;
     }
 
+    /// connects to an IPv4 or IPv6 address such as those of dns_cache, addr is copied
+    bool connect(const sockaddr* addr, CallbackWithResult callback)
+    {
+        return connect_status(addr, std::move(callback)) == 0;
+    }
+
+    /// connect returning the status of uv_tcp_connect, such as UV_EAFNOSUPPORT
+    int connect_status(const sockaddr* addr, CallbackWithResult callback)
+    {
+        slots(get()->data).store<internal::uv_cid_connect>(callback);
+        return connect_to(addr, [](uv_connect_t* req, int status)
+        {
+            uv_stream_t* s = req->handle;
+            internal::get_slab(s->loop).destroy(req);
+            slots(s->data).invoke<internal::uv_cid_connect>(error(status));
+        });
+    }
+
+    bool connect(const endpoint& ep, CallbackWithResult callback)
+    {
+        return connect(ep.get(), std::move(callback));
+    }
+
     bool getsockname(bool& ip4, std::string& ip, int& port)
     {
         struct sockaddr_storage addr;
@@ -95,5 +171,38 @@ public:
         }
         return false;
     }
+
+    bool getsockname(endpoint& ep)
+    {
+        struct sockaddr_storage addr;
+        int len = sizeof(addr);
+        if (uv_tcp_getsockname(get(), reinterpret_cast<struct sockaddr*>(&addr), &len) != 0)
+            return false;
+        ep = endpoint(reinterpret_cast<const sockaddr*>(&addr));
+        return true;
+    }
+
+    /// the peer without formatting it, cheap enough for every accept
+    bool getpeername(endpoint& ep)
+    {
+        struct sockaddr_storage addr;
+        int len = sizeof(addr);
+        if (uv_tcp_getpeername(get(), reinterpret_cast<struct sockaddr*>(&addr), &len) != 0)
+            return false;
+        ep = endpoint(reinterpret_cast<const sockaddr*>(&addr));
+        return true;
+    }
+
+private:
+    /// connects with a request from the loop's slab, which cb gives back
+    int connect_to(const sockaddr* addr, uv_connect_cb cb)
+    {
+        slab& requests = internal::get_slab(get()->loop);
+        uv_connect_t* req = requests.create<uv_connect_t>();
+        const int res = uv_tcp_connect(req, get(), addr, cb);
+        if (res != 0)
+            requests.destroy(req);
+        return res;
+    }
 };
 }
@@ -2,31 +2,40 @@
 
 #include "handle.hpp"
 #include "error.hpp"
+#include "loop.hpp"
 #include <chrono>
 
 namespace uvpp {
+namespace internal {
+template<>
+struct handle_traits<uv_timer_t>
+{
+    typedef callback_slots<uv_cid_close, uv_cid_timer> callbacks_type;
+};
+}
+
 class Timer : public handle<uv_timer_t>
 {
 public:
     Timer():
-        handle<uv_timer_t>()
+        handle<uv_timer_t>(uv_default_loop())
     {
         uv_timer_init(uv_default_loop(), get());
     }
 
     Timer(loop& l):
-        handle<uv_timer_t>()
+        handle<uv_timer_t>(l.get())
     {
         uv_timer_init(l.get(), get());
     }
 
     error start(std::function<void()> callback, const std::chrono::duration<uint64_t, std::milli> &timeout, const std::chrono::duration<uint64_t, std::milli> &repeat)
     {
-        callbacks::store(get()->data, internal::uv_cid_timer, callback);
+        slots(get()->data).store<internal::uv_cid_timer>(callback);
         return error(uv_timer_start(get(),
                                     [](uv_timer_t* handle)
         {
-            callbacks::invoke<decltype(callback)>(handle->data, internal::uv_cid_timer);
+            slots(handle->data).invoke<internal::uv_cid_timer>();
         },
         timeout.count(),
         repeat.count()
@@ -35,11 +44,11 @@ public:
 
     error start(std::function<void()> callback, const std::chrono::duration<uint64_t, std::milli> &timeout)
     {
-        callbacks::store(get()->data, internal::uv_cid_timer, callback);
+        slots(get()->data).store<internal::uv_cid_timer>(callback);
         return error(uv_timer_start(get(),
                                     [](uv_timer_t* handle)
         {
-            callbacks::invoke<decltype(callback)>(handle->data, internal::uv_cid_timer);
+            slots(handle->data).invoke<internal::uv_cid_timer>();
         },
         timeout.count(),
         0
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "timer.hpp"
+#include "loop.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+
+namespace uvpp {
+/**
+ * Hierarchical timing wheel for large numbers of coarse timeouts, such as one idle timeout per
+ * connection, driven by a single Timer.
+ *
+ * Timeouts are intrusive nodes embedded in the caller's objects: arm, re-arm and cancel are O(1)
+ * list operations without allocation. Time advances in ticks, a timeout fires on the first tick at
+ * or after its expiry. Four levels of 64 slots cover 2^24 ticks, 46 hours with the default tick,
+ * and are cascaded down as time goes. The Timer only runs while timeouts are armed.
+ *
+ * Destroying the wheel disarms the timeouts still armed and closes its Timer, so like a handle it
+ * has to be destroyed before its loop. close() is only needed to learn when the Timer is closed,
+ * before closing the loop for instance; the wheel mustn't be armed afterwards.
+ */
+class timer_wheel
+{
+public:
+    /**
+     * Timeout to embed in an object, run(node) is called when it fires. Destroying it cancels it.
+     */
+    struct node
+    {
+        node():
+            prev(this)
+            , next(this)
+            , expires(0)
+            , wheel(nullptr)
+            , run(nullptr)
+            , data(nullptr)
+        {
+        }
+
+        ~node()
+        {
+            if (wheel)
+                wheel->cancel(*this);
+        }
+
+        node(const node&) = delete;
+        node& operator=(const node&) = delete;
+
+        bool armed() const
+        {
+            return wheel != nullptr;
+        }
+
+        node* prev;
+        node* next;
+        /// tick it fires on
+        uint64_t expires;
+        /// wheel it's armed on
+        timer_wheel* wheel;
+        void (*run)(node*);
+        void* data;
+    };
+
+    static const unsigned slot_bits = 6;
+    static const unsigned slots = 1 << slot_bits;
+    static const unsigned levels = 4;
+
+    explicit timer_wheel(loop& l, std::chrono::duration<uint64_t, std::milli> tick = std::chrono::milliseconds(10)):
+        m_loop(l.get())
+        , m_tick_ms(std::max<uint64_t>(tick.count(), 1))
+        , m_tick(0)
+        , m_size(0)
+        , m_running(false)
+        , m_timer(l)
+    {
+    }
+
+    /// the timeouts still armed are disarmed without firing
+    ~timer_wheel()
+    {
+        for (unsigned level = 0; level < levels; ++level)
+        {
+            for (unsigned slot = 0; slot < slots; ++slot)
+                disarm_all(m_slots[level][slot]);
+        }
+        disarm_all(m_overflow);
+    }
+
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+    /// arms n, re-arming it if it was armed already
+    void arm(node& n, std::chrono::duration<uint64_t, std::milli> timeout)
+    {
+        assert(n.run);
+        if (n.wheel)
+            unlink(n);
+        if (! m_running)
+            start();
+
+        // ceil so that it never fires early, and at least on the next tick
+        const uint64_t now = uv_now(m_loop);
+        n.expires = std::max((now + timeout.count() + m_tick_ms - 1) / m_tick_ms, m_tick + 1);
+        n.wheel = this;
+        ++m_size;
+        place(n);
+    }
+
+    void cancel(node& n)
+    {
+        if (! n.wheel)
+            return;
+        assert(n.wheel == this);
+        unlink(n);
+    }
+
+    /// armed timeouts
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    std::chrono::milliseconds tick() const
+    {
+        return std::chrono::milliseconds(m_tick_ms);
+    }
+
+    void close(Callback callback = [] {})
+    {
+        m_timer.close(std::move(callback));
+    }
+
+private:
+    static void link(node& list, node& n)
+    {
+        n.prev = list.prev;
+        n.next = &list;
+        list.prev->next = &n;
+        list.prev = &n;
+    }
+
+    void unlink(node& n)
+    {
+        n.prev->next = n.next;
+        n.next->prev = n.prev;
+        n.prev = n.next = &n;
+        n.wheel = nullptr;
+        --m_size;
+    }
+
+    void disarm_all(node& list)
+    {
+        while (list.next != &list)
+            unlink(*list.next);
+    }
+
+    /// moves all the nodes of from to the empty list to
+    static void splice(node& from, node& to)
+    {
+        if (from.next == &from)
+            return;
+        to.next = from.next;
+        to.prev = from.prev;
+        to.next->prev = &to;
+        to.prev->next = &to;
+        from.next = from.prev = &from;
+    }
+
+    /**
+     * Into the lowest level whose slots above it agree with the current tick, so that the slot is
+     * always ahead of the current one on that level
+     */
+    void place(node& n)
+    {
+        if (n.expires <= m_tick)
+        {
+            link(m_slots[0][m_tick & (slots - 1)], n);
+            return;
+        }
+
+        for (unsigned level = 0; level < levels; ++level)
+        {
+            const unsigned shift = slot_bits * (level + 1);
+            if ((n.expires >> shift) == (m_tick >> shift))
+            {
+                link(m_slots[level][(n.expires >> (slot_bits * level)) & (slots - 1)], n);
+                return;
+            }
+        }
+        link(m_overflow, n);
+    }
+
+    void start()
+    {
+        // nothing is armed, catch up with the loop's time
+        m_tick = uv_now(m_loop) / m_tick_ms;
+        m_running = true;
+        m_timer.start([this]() { advance(); }, std::chrono::milliseconds(m_tick_ms), std::chrono::milliseconds(m_tick_ms));
+    }
+
+    void advance()
+    {
+        const uint64_t target = uv_now(m_loop) / m_tick_ms;
+        while (m_tick < target && m_size)
+        {
+            ++m_tick;
+            cascade(1);
+            expire(m_slots[0][m_tick & (slots - 1)]);
+        }
+
+        if (! m_size)
+        {
+            m_timer.stop();
+            m_running = false;
+        }
+    }
+
+    /// when the level below wrapped around, spreads the current slot of level over the lower ones
+    void cascade(unsigned level)
+    {
+        if (((m_tick >> (slot_bits * (level - 1))) & (slots - 1)) != 0)
+            return;
+        if (level == levels)
+        {
+            redistribute(m_overflow);
+            return;
+        }
+        cascade(level + 1);
+        redistribute(m_slots[level][(m_tick >> (slot_bits * level)) & (slots - 1)]);
+    }
+
+    void redistribute(node& list)
+    {
+        node pending;
+        splice(list, pending);
+        while (pending.next != &pending)
+        {
+            node* n = pending.next;
+            n->prev->next = n->next;
+            n->next->prev = n->prev;
+            place(*n);
+        }
+    }
+
+    void expire(node& list)
+    {
+        // callbacks may arm or cancel any node, so take the slot's nodes one at a time
+        while (list.next != &list)
+        {
+            node* n = list.next;
+            unlink(*n);
+            n->run(n);
+        }
+    }
+
+    uv_loop_t* m_loop;
+    uint64_t m_tick_ms;
+    /// last tick processed
+    uint64_t m_tick;
+    size_t m_size;
+    bool m_running;
+    node m_slots[levels][slots];
+    /// timeouts beyond the last level, looked at again each time it wraps around
+    node m_overflow;
+    Timer m_timer;
+};
+}
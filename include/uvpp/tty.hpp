@@ -1,9 +1,20 @@
 #pragma once
 
-#include "handle.hpp"
+#include "stream.hpp"
 #include "error.hpp"
+#include "loop.hpp"
 
 namespace uvpp {
+namespace internal {
+template<>
+struct handle_traits<uv_tty_t>
+{
+    typedef callback_slots<
+        uv_cid_close, uv_cid_listen, uv_cid_read_start, uv_cid_read_buffer,
+        uv_cid_read_prepare, uv_cid_drain, uv_cid_congested, uv_cid_shutdown> callbacks_type;
+};
+}
+
 class TTY : public stream<uv_tty_t>
 {
 public:
@@ -16,13 +27,13 @@ public:
     };
 
     TTY(Type type, bool readable):
-        stream<uv_tty_t>(), type_(type)
+        stream<uv_tty_t>(uv_default_loop()), type_(type)
     {
         uv_tty_init(uv_default_loop(), get(), static_cast<int>(type_), static_cast<int>(readable));
     }
 
     TTY(loop& l, Type type, bool readable):
-        stream<uv_tty_t>(), type_(type)
+        stream<uv_tty_t>(l.get()), type_(type)
     {
         uv_tty_init(l.get(), get(), static_cast<int>(type_), static_cast<int>(readable));
     }
@@ -0,0 +1,311 @@
+#pragma once
+
+#include "handle.hpp"
+#include "net.hpp"
+#include "loop.hpp"
+
+#include <algorithm>
+#include <errno.h>
+#include <memory>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+
+namespace uvpp {
+namespace internal {
+/**
+ * Receive buffer of a Udp, allocated by the first read and reused by all the others since a socket
+ * has a single read in flight
+ */
+struct udp_state
+{
+    udp_state():
+        batch(1)
+        , size(0)
+    {
+    }
+
+    unsigned batch;
+    std::unique_ptr<char[]> buffer;
+    size_t size;
+};
+
+template<>
+struct handle_state<uv_udp_t>
+{
+    typedef udp_state type;
+};
+
+template<>
+struct handle_traits<uv_udp_t>
+{
+    typedef callback_slots<uv_cid_close, uv_cid_udp_recv> callbacks_type;
+};
+
+/**
+ * A uv_udp_send_t carrying the completion callback of its own send
+ */
+struct udp_send_request
+{
+    udp_send_request()
+    {
+        req.data = this;
+    }
+
+    uv_udp_send_t req;
+    inline_callback<void(error)> callback;
+};
+}
+
+/**
+ * Datagram of a batch, see Udp::try_send_batch
+ */
+struct datagram
+{
+    const char* data;
+    size_t len;
+    const sockaddr* addr;
+};
+
+/**
+ * UDP socket.
+ *
+ * With recv_batch above 1 the socket reads up to that many datagrams per system call with
+ * recvmmsg, where libuv supports it (Linux, FreeBSD), libuv reading at most 20 at once. The
+ * receive buffer, recv_batch times the largest datagram, is allocated once per socket: the data
+ * given to the receive callback is only valid during the call.
+ *
+ * send queues a datagram with a request from the loop's slab. try_send_batch sends what the
+ * socket takes of a batch right away, with sendmmsg on Linux.
+ */
+class Udp : public handle<uv_udp_t>
+{
+public:
+    /// flags are the uv_udp_flags of the datagram, such as UV_UDP_PARTIAL when it was truncated
+    typedef std::function<void(const char* data, ssize_t len, const sockaddr* addr, unsigned flags)> RecvCallback;
+
+    /// largest datagram libuv reads
+    static const size_t max_datagram = 64 * 1024;
+
+    explicit Udp(unsigned recv_batch = 1):
+        handle<uv_udp_t>(uv_default_loop())
+    {
+        init(uv_default_loop(), recv_batch);
+    }
+
+    explicit Udp(loop& l, unsigned recv_batch = 1):
+        handle<uv_udp_t>(l.get())
+    {
+        init(l.get(), recv_batch);
+    }
+
+    bool bind(const std::string& ip, int port, unsigned flags = 0)
+    {
+        ip4_addr addr = to_ip4_addr(ip, port);
+        return uv_udp_bind(get(), reinterpret_cast<const sockaddr*>(&addr), flags) == 0;
+    }
+
+    bool bind6(const std::string& ip, int port, unsigned flags = 0)
+    {
+        ip6_addr addr = to_ip6_addr(ip, port);
+        return uv_udp_bind(get(), reinterpret_cast<const sockaddr*>(&addr), flags) == 0;
+    }
+
+    bool bind(const endpoint& ep, unsigned flags = 0)
+    {
+        return uv_udp_bind(get(), ep.get(), flags) == 0;
+    }
+
+    bool getsockname(endpoint& ep)
+    {
+        struct sockaddr_storage addr;
+        int len = sizeof(addr);
+        if (uv_udp_getsockname(get(), reinterpret_cast<struct sockaddr*>(&addr), &len) != 0)
+            return false;
+        ep = endpoint(reinterpret_cast<const sockaddr*>(&addr));
+        return true;
+    }
+
+    bool getsockname(bool& ip4, std::string& ip, int& port)
+    {
+        struct sockaddr_storage addr;
+        int len = sizeof(addr);
+        if (uv_udp_getsockname(get(), reinterpret_cast<struct sockaddr*>(&addr), &len) == 0)
+        {
+            ip4 = (addr.ss_family == AF_INET);
+            if (ip4) return from_ip4_addr(reinterpret_cast<ip4_addr*>(&addr), ip, port);
+            else return from_ip6_addr(reinterpret_cast<ip6_addr*>(&addr), ip, port);
+        }
+        return false;
+    }
+
+    bool set_broadcast(bool enable)
+    {
+        return uv_udp_set_broadcast(get(), enable ? 1 : 0) == 0;
+    }
+
+    bool set_ttl(int ttl)
+    {
+        return uv_udp_set_ttl(get(), ttl) == 0;
+    }
+
+    /// whether reads go through recvmmsg
+    bool using_recvmmsg() const
+    {
+        return uv_udp_using_recvmmsg(get()) != 0;
+    }
+
+    bool recv_start(RecvCallback callback)
+    {
+        slots(get()->data).store<internal::uv_cid_udp_recv>(std::move(callback));
+        return uv_udp_recv_start(get(),
+                                 [](uv_handle_t* h, size_t, uv_buf_t* buf)
+        {
+            internal::udp_state& st = state(h->data);
+            if (! st.buffer)
+            {
+                st.size = st.batch * max_datagram;
+                st.buffer.reset(new char[st.size]);
+            }
+            *buf = uv_buf_init(st.buffer.get(), static_cast<unsigned int>(st.size));
+        },
+        [](uv_udp_t* h, ssize_t nread, const uv_buf_t* buf, const sockaddr* addr, unsigned flags)
+        {
+            // the end of a recvmmsg batch: the buffer is the socket's, nothing to free
+            if (flags & UV_UDP_MMSG_FREE)
+                return;
+            // nothing more to read
+            if (nread == 0 && ! addr)
+                return;
+            slots(h->data).invoke<internal::uv_cid_udp_recv>(nread < 0 ? nullptr : buf->base, nread, addr, flags);
+        }) == 0;
+    }
+
+    bool recv_stop()
+    {
+        return uv_udp_recv_stop(get()) == 0;
+    }
+
+    /// addr is copied, data has to stay valid until callback
+    bool send(const char* data, size_t len, const sockaddr* addr, CallbackWithResult callback)
+    {
+        uv_buf_t buf = uv_buf_init(const_cast<char*>(data), static_cast<unsigned int>(len));
+        slab& requests = internal::get_slab(get()->loop);
+        internal::udp_send_request* req = requests.create<internal::udp_send_request>();
+        req->callback.assign(std::move(callback));
+        if (uv_udp_send(&req->req, get(), &buf, 1, addr, &Udp::on_send) != 0)
+        {
+            requests.destroy(req);
+            return false;
+        }
+        return true;
+    }
+
+    bool send(const char* data, size_t len, const std::string& ip, int port, CallbackWithResult callback)
+    {
+        ip4_addr addr = to_ip4_addr(ip, port);
+        return send(data, len, reinterpret_cast<const sockaddr*>(&addr), std::move(callback));
+    }
+
+    /// bytes sent right away, or UV_EAGAIN when sends are queued or the socket is full
+    int try_send(const char* data, size_t len, const sockaddr* addr)
+    {
+        uv_buf_t buf = uv_buf_init(const_cast<char*>(data), static_cast<unsigned int>(len));
+        return uv_udp_try_send(get(), &buf, 1, addr);
+    }
+
+    /**
+     * Sends the datagrams the socket takes right away, from the front of the batch. Returns how
+     * many, or UV_EAGAIN or another error if it took none. Like try_send it doesn't get ahead of
+     * queued sends, the rest of the batch can be queued with send.
+     */
+    int try_send_batch(const datagram* datagrams, size_t count)
+    {
+        if (! count)
+            return 0;
+        if (uv_udp_get_send_queue_count(get()))
+            return UV_EAGAIN;
+
+#if defined(__linux__)
+        uv_os_fd_t fd;
+        // until the first bind or send the socket doesn't exist, let libuv create it
+        if (uv_fileno(get<uv_handle_t>(), &fd) == 0)
+            return sendmmsg_batch(fd, datagrams, count);
+#endif
+        size_t sent = 0;
+        for (; sent < count; ++sent)
+        {
+            const int r = try_send(datagrams[sent].data, datagrams[sent].len, datagrams[sent].addr);
+            if (r < 0)
+                return sent ? static_cast<int>(sent) : r;
+        }
+        return static_cast<int>(sent);
+    }
+
+    /// bytes waiting in the send queue
+    size_t send_queue_size() const
+    {
+        return uv_udp_get_send_queue_size(get());
+    }
+
+private:
+    void init(uv_loop_t* l, unsigned recv_batch)
+    {
+        state(get()->data).batch = std::max(recv_batch, 1u);
+        uv_udp_init_ex(l, get(), recv_batch > 1 ? UV_UDP_RECVMMSG : 0);
+    }
+
+    static void on_send(uv_udp_send_t* r, int status)
+    {
+        internal::udp_send_request* req = static_cast<internal::udp_send_request*>(r->data);
+        internal::inline_callback<void(error)> callback(std::move(req->callback));
+        uv_udp_t* u = r->handle;
+        internal::get_slab(u->loop).destroy(req);
+        slots(u->data).call<internal::uv_cid_udp_send>(callback, error(status));
+    }
+
+#if defined(__linux__)
+    static int sendmmsg_batch(int fd, const datagram* datagrams, size_t count)
+    {
+        const size_t width = 64;
+        mmsghdr msgs[width];
+        iovec iov[width];
+        size_t sent = 0;
+        while (sent < count)
+        {
+            const size_t n = std::min(count - sent, width);
+            for (size_t i = 0; i < n; ++i)
+            {
+                const datagram& d = datagrams[sent + i];
+                iov[i].iov_base = const_cast<char*>(d.data);
+                iov[i].iov_len = d.len;
+                msgs[i] = mmsghdr();
+                msgs[i].msg_hdr.msg_name = const_cast<sockaddr*>(d.addr);
+                msgs[i].msg_hdr.msg_namelen = d.addr->sa_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            int r;
+            do
+            {
+                r = ::sendmmsg(fd, msgs, static_cast<unsigned int>(n), 0);
+            }
+            while (r < 0 && errno == EINTR);
+
+            if (r < 0)
+            {
+                if (sent)
+                    break;
+                return errno == EWOULDBLOCK ? UV_EAGAIN : uv_translate_sys_error(errno);
+            }
+            sent += static_cast<size_t>(r);
+            if (static_cast<size_t>(r) < n)
+                break;
+        }
+        return static_cast<int>(sent);
+    }
+#endif
+};
+}
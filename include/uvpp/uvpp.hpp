@@ -1,5 +1,6 @@
 #include <uv.h>
 #include "tcp.hpp"
+#include "udp.hpp"
 #include "timer.hpp"
 #include "tty.hpp"
 #include "work.hpp"
@@ -8,3 +9,16 @@
 #include "fspoll.hpp"
 #include "fsevent.hpp"
 #include "pipe.hpp"
+#include "ring_buffer.hpp"
+#include "output_queue.hpp"
+#include "sharded_server.hpp"
+#include "handoff_server.hpp"
+#include "loop_executor.hpp"
+#include "channel.hpp"
+#include "coroutine.hpp"
+#include "timer_wheel.hpp"
+#include "connection_pool.hpp"
+#include "dns_cache.hpp"
+#include "happy_eyeballs.hpp"
+#include "connection_registry.hpp"
+#include "fanout.hpp"
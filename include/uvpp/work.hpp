@@ -5,10 +5,18 @@
 #include "loop.hpp"
 
 namespace uvpp {
+namespace internal {
+template<>
+struct handle_traits<uv_work_t>
+{
+    typedef callback_slots<uv_cid_work, uv_cid_after_work> callbacks_type;
+};
+}
+
 class Work : public request<uv_work_t>
 {
 public:
-    Work(loop& l) : request<uv_work_t>(), loop_(l.get())
+    Work(loop& l) : request<uv_work_t>(l.get()), loop_(l.get())
     {
 
     }
@@ -17,18 +25,18 @@ public:
     {
 
 
-        callbacks::store(get()->data, internal::uv_cid_work, callback);
-        callbacks::store(get()->data, internal::uv_cid_after_work, afterCallback);
+        slots(get()->data).store<internal::uv_cid_work>(callback);
+        slots(get()->data).store<internal::uv_cid_after_work>(afterCallback);
 
         return (
                    uv_queue_work(loop_, get(),
                                  [](uv_work_t* req)
         {
-            callbacks::invoke<decltype(callback)>(req->data, internal::uv_cid_work);
+            slots(req->data).invoke<internal::uv_cid_work>();
         },
         [](uv_work_t* req, int status)
         {
-            callbacks::invoke<decltype(afterCallback)>(req->data, internal::uv_cid_after_work, error(status));
+            slots(req->data).invoke<internal::uv_cid_after_work>(error(status));
         }) == 0
                );
     }
@@ -1,10 +1,9 @@
 #include "Server.h"
-#include "uvpp/make_unique_define.h"
 #include <iostream>
 
 using namespace std;
 
-Server::Server() : m_running(false), m_port(0), m_loop(), m_tcp_listen_conn(m_loop), m_async(m_loop, bind(&Server::on_async, this)), m_on_close(), m_on_connect()
+Server::Server() : m_running(false), m_port(0), m_loop(), m_tcp_listen_conn(m_loop), m_executor(m_loop), m_on_close(), m_on_connect()
 {
 }
 
@@ -32,96 +31,62 @@ void Server::stop()
 	m_running = false;
 }
 
-void Server::send(const string &peer, const string &msg)
+void Server::send(connection_id id, string msg)
 {
-	std::lock_guard<std::mutex> l(m_send_lock);
-	m_sendBuf.push_back(msg_buf(peer, msg));
-	m_async.send();
-}
-
-void Server::on_async()
-{
-	std::lock_guard<std::mutex> l(m_send_lock);
-	while (!m_sendBuf.empty())
-	{
-		const msg_buf &buf = m_sendBuf.front();
-		auto iter = m_connections.find(buf.peer);
-		if (iter != m_connections.end())
+	// bound rather than captured, C++11 lambdas can't move msg in
+	m_executor.post(std::bind([this, id](string &payload) {
+		if (TcpConnection *conn = m_connections.get(id))
 		{
-			iter->second->send_msg(move(buf.msg));
+			conn->send_msg(move(payload));
 		}
-		m_sendBuf.pop_front();
-	}
+	}, move(msg)));
 }
 
 void Server::on_tcp_connect(uvpp::error error)
 {
-	auto tcp_conn_ptr = make_unique<TcpConnection>(m_loop);
-	TcpConnection &tcp_conn = *tcp_conn_ptr;
+	const connection_id id = m_connections.emplace(m_loop);
+	TcpConnection &tcp_conn = *m_connections.get(id);
 	m_tcp_listen_conn.accept(tcp_conn.m_tcp);
 
-	string peer_ip;
-	int port;
-	bool ip4;
-	const bool getpeername_ok = tcp_conn.m_tcp.getpeername(ip4, peer_ip, port);
+	uvpp::endpoint peer;
+	const bool getpeername_ok = tcp_conn.m_tcp.getpeername(peer);
 	assert(getpeername_ok);
 	(void)getpeername_ok;
-	ostringstream os;
-	os << "tcp://" << peer_ip << ":" << port;
-	string peer_ = os.str();
-
-	tcp_conn.set_peer_name(peer_);
-
-	auto res = m_connections.emplace(piecewise_construct,
-																	 forward_as_tuple(move(peer_)),
-																	 forward_as_tuple(move(tcp_conn_ptr)));
-
-	assert(res.second);
-	const string &peer = res.first->first; // reference that will stay valid
+	tcp_conn.set_peer(peer);
 
 	if (m_on_connect)
 	{
-		m_on_connect(peer);
+		m_on_connect(id);
 	}
 
-	cout << "receive new connect:" << peer << " size = " << m_connections.size() << endl;
+	cout << "receive new connect: tcp://" << peer.to_string() << " size = " << m_connections.size() << endl;
 
-	auto close_cb = [this, &peer]() {
+	auto close_cb = [this, id]() {
 		if (m_on_close)
-			m_on_close(peer);
-		m_connections.erase(peer);
+			m_on_close(id);
+		m_connections.erase(id);
 	};
 
-	// write finished callback
-	auto write_cb = [&tcp_conn, close_cb](uvpp::error error) {
-		if (!error)
-		{
-			tcp_conn.on_write_finished();
-		}
-		else
-		{
-			tcp_conn.m_tcp.close(close_cb);
-		}
-	};
+	// a failed write means the connection is gone
+	tcp_conn.m_output_buff.on_error([&tcp_conn, close_cb](uvpp::error) {
+		tcp_conn.m_tcp.close(close_cb);
+	});
 
-	// function to be called when the the protocol needs to write
-	auto do_write = [&tcp_conn, write_cb](const char *buff, size_t sz) {
-		tcp_conn.m_tcp.write(buff, sz, write_cb);
+	auto read_space = [&tcp_conn](size_t suggested_size) {
+		return tcp_conn.input_space(suggested_size);
 	};
 
-	auto read_cb = [&tcp_conn, &peer, close_cb](const char *buff, ssize_t len) {
+	auto read_cb = [&tcp_conn, close_cb](const char *, ssize_t len) {
 		if (len < 0)
 		{
-			cerr << "TCP client read error: " << peer << endl;
+			cerr << "TCP client read error: " << tcp_conn.peer().to_string() << endl;
 			tcp_conn.m_tcp.close(close_cb);
 		}
 		else
 		{
-			tcp_conn.input(buff, static_cast<size_t>(len));
+			tcp_conn.input_committed(static_cast<size_t>(len));
 		}
 	};
 
-	tcp_conn.set_write_fun(do_write);
-
-	tcp_conn.m_tcp.read_start(read_cb);
+	tcp_conn.m_tcp.read_start_into(read_space, read_cb);
 }
@@ -1,26 +1,17 @@
 #pragma once
 #include "TcpConnection.h"
-#include <map>
 #include <functional>
-#include "uvpp/async.hpp"
+#include "uvpp/loop_executor.hpp"
+#include "uvpp/connection_registry.hpp"
 #include <string>
-#include <mutex>
-
-struct msg_buf
-{
-	msg_buf(std::string p, std::string m) : peer(p), msg(m)
-	{
-	}
-
-	std::string peer;
-	std::string msg;
-};
 
 class Server
 {
 public:
-	typedef std::function<void(const std::string &peer)> on_close_t;
-	typedef std::function<void(const std::string &peer)> on_connect_t;
+	typedef uvpp::connection_registry<TcpConnection> connections_t;
+	typedef connections_t::id_type connection_id;
+	typedef std::function<void(connection_id id)> on_close_t;
+	typedef std::function<void(connection_id id)> on_connect_t;
 	Server();
 	~Server();
 
@@ -28,11 +19,11 @@ public:
 	void start();
 	void stop();
 
-	void send(const std::string &peer, const std::string &msg);
+	/// from any thread, dropped if the connection is gone
+	void send(connection_id id, std::string msg);
 
 private:
 	void on_tcp_connect(uvpp::error error);
-	void on_async();
 
 private:
 	int m_port;
@@ -43,10 +34,9 @@ private:
 	on_close_t m_on_close;
 	on_connect_t m_on_connect;
 
-	uvpp::Async m_async;
-	std::mutex m_send_lock;
-	std::deque<msg_buf> m_sendBuf;
+	/// runs the sends of other threads on the loop
+	uvpp::loop_executor m_executor;
 
-	/// connection identifier to Connection
-	std::map<std::string, std::unique_ptr<TcpConnection>> m_connections;
+	/// connections by id, only touched from the loop's thread
+	connections_t m_connections;
 };
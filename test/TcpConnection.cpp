@@ -2,14 +2,10 @@
 #include "TcpConnection.h"
 #include <iostream>
 #include <string.h>
+#include <algorithm>
 
 using namespace std;
 
-void TcpConnection::set_peer_name(std::string &peer_name)
-{
-	m_peerName = peer_name;
-}
-
 /**
 * Check if we have a full message then decode it and handle, otherwise wait for more data, same for
 * payload.
@@ -20,31 +16,26 @@ void TcpConnection::input(const char *data, size_t len)
 	buf.resize(len);
 	memcpy(&buf[0], data, len);
 	buf.push_back('\0');
-	cout << m_peerName << ":" << buf << " len:" << len << endl;
+	cout << m_peer.to_string() << ":" << buf << " len:" << len << endl;
 }
 
-void TcpConnection::send_msg(const std::string &&msg)
+uv_buf_t TcpConnection::input_space(size_t suggested_size)
 {
-	const bool do_write = m_output_buff.empty() == true;
-	m_output_buff.emplace_back(move(msg));
-	if (do_write)
-		write_next_buff();
+	return m_input_buff.prepare(min(suggested_size, static_cast<size_t>(4096)));
 }
 
-void TcpConnection::write_next_buff()
+void TcpConnection::input_committed(size_t len)
 {
-	assert(!m_write_in_progress);
-	assert(!m_output_buff.empty());
-	const string &buf = m_output_buff.front();
-	m_do_write(buf.c_str(), buf.size());
-	m_write_in_progress = true;
+	m_input_buff.commit(len);
+	if (m_input_buff.empty())
+		return;
+	cout << m_peer.to_string() << ":";
+	cout.write(m_input_buff.data(), m_input_buff.size());
+	cout << " len:" << m_input_buff.size() << endl;
+	m_input_buff.consume(m_input_buff.size());
 }
 
-void TcpConnection::on_write_finished()
+void TcpConnection::send_msg(std::string &&msg)
 {
-	m_write_in_progress = false;
-	assert(!m_output_buff.empty());
-	m_output_buff.pop_front();
-	if (!m_output_buff.empty())
-		write_next_buff();
+	m_output_buff.push(move(msg));
 }
\ No newline at end of file
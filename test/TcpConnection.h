@@ -1,31 +1,32 @@
 #pragma once
 #include "uvpp/loop.hpp"
 #include "uvpp/tcp.hpp"
-#include <deque>
+#include "uvpp/ring_buffer.hpp"
+#include "uvpp/output_queue.hpp"
 
 class TcpConnection
 {
 public:
-	/// type of callback for writing data
-	typedef std::function<void(char const*, size_t)> do_write_t;
-
 	/// when the protocol can't make sense of the data we should probably close the connection
 	typedef std::function<void()> handle_error_t;
 
 
 	TcpConnection(uvpp::loop &loop) :
 		r_loop(loop)
+		, m_output_buff(static_cast<uvpp::stream<uv_tcp_t>&>(m_tcp))
 		, m_tcp(loop)
-		, m_write_in_progress(false)
 	{
 
 	};
 
-	void set_peer_name(std::string& peer_name);
+	void set_peer(const uvpp::endpoint& peer)
+	{
+		m_peer = peer;
+	}
 
-	void set_write_fun(do_write_t do_write)
+	const uvpp::endpoint& peer() const
 	{
-		m_do_write = do_write;
+		return m_peer;
 	}
 
 	void input(const std::string& s)
@@ -40,33 +41,29 @@ public:
 	*/
 	void input(const char* data, size_t len);
 
+	/// space at the tail of the input buffer for the socket to read into
+	uv_buf_t input_space(size_t suggested_size);
 
-	/// to be called by the event library on write when the last write finished
-	void on_write_finished();
+	/// len bytes were read into the space returned by input_space, process what can be processed
+	void input_committed(size_t len);
 
-	/**
-	* will write the next output buffer by calling the write function @sa m_do_write
-	* @post m_write_in_progress will be true
-	*/
-	void write_next_buff();
-
-	void send_msg(const std::string&& msg);
+	/// queues msg, everything queued during a loop iteration is written together at its end
+	void send_msg(std::string&& msg);
 
 private:
-	/// internal input buffer accumulating data until it can be processed
-	std::string m_input_buff;
-	/// queue of buffers to write, we write from front to back, new appended to back, when wrote,
-	/// removed from front.
-	std::deque<std::string> m_output_buff;
+	/// internal input buffer accumulating data until it can be processed, the socket reads into it
+	uvpp::ring_buffer m_input_buff;
 
-	std::string m_peerName;
+	/// formatted only when logged
+	uvpp::endpoint m_peer;
 
 public:
 	uvpp::loop &r_loop;
+	/// queue of messages to write, flushed at the end of each loop iteration; declared before
+	/// m_tcp so that it outlives the socket and the writes it closes, it only binds the stream
+	/// before m_tcp is constructed
+	uvpp::output_queue<uv_tcp_t> m_output_buff;
 	uvpp::Tcp m_tcp;
-	do_write_t m_do_write;
-
-	bool m_write_in_progress;
 
 	handle_error_t m_handle_error;
 };